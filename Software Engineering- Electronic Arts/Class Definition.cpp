@@ -0,0 +1,2948 @@
+// game_combat_system.cpp
+#include "Class Definition.h"
+#include "Instrumentation.h"
+
+#include <algorithm> // For std::min, std::max, std::find
+#include <cctype>    // For std::isdigit, std::isalnum in ability scripts
+#include <cmath>     // For std::floor
+#include <cstdlib>   // For std::strtol
+#include <tuple>     // For std::tie in sort keys
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+namespace {
+constexpr int spellBaseDamage = 20;
+constexpr int spellResourceCost = 10;
+constexpr int buffDamageBonusPercent = 10;       // Per Buff on the caster
+constexpr int debuffVulnerabilityPercent = 10;   // Per Debuff on the target
+
+int abilityBaseDamage(const Ability& ability) {
+    switch (ability.kind) {
+        case AbilityKind::Melee:
+            return static_cast<const MeleeAttack&>(ability).baseDamage;
+        case AbilityKind::Spell:
+            return static_cast<const SpellCast&>(ability).baseDamage;
+        default:
+            return 0;
+    }
+}
+
+// The damage formula itself, shared by DamageCalculator and DamagePipeline
+inline int scaleDamage(int base, int level, int bonusPercent) {
+    int scaled = base + base * level / 10;
+    return scaled + scaled * bonusPercent / 100;
+}
+
+// Current health from whichever storage holds it, 0 without any
+int healthOf(const Character& character) {
+    if (character.world) {
+        return character.world->isValid(character.entity)
+                   ? character.world->health.currentHealth[character.world->slotOf(character.entity)]
+                   : 0;
+    }
+    return character.health ? character.health->currentHealth : 0;
+}
+
+int maxHealthOf(const Character& character) {
+    if (character.world) {
+        return character.world->isValid(character.entity)
+                   ? character.world->health.maxHealth[character.world->slotOf(character.entity)]
+                   : 0;
+    }
+    return character.health ? character.health->maxHealth : 0;
+}
+
+// Current mana or rage, 0 without a pool
+int manaOf(const Character& character) {
+    if (character.world) {
+        return character.world->isValid(character.entity)
+                   ? character.world->mana.currentMana[character.world->slotOf(character.entity)]
+                   : 0;
+    }
+    return character.mana ? character.mana->currentMana : 0;
+}
+}
+
+// --- Character Class ---
+
+Character::Character(const std::string& name, int level)
+    : name(name), level(level), world(nullptr), entity(invalidEntity), position{0.0f, 0.0f}, facing{1.0f, 0.0f},
+      timers(nullptr), log(nullptr), logId(0) {}
+
+Character::Character(const std::string& name, int level, CombatWorld& world, EntityId entity)
+    : name(name), level(level), world(&world), entity(entity), position{0.0f, 0.0f}, facing{1.0f, 0.0f},
+      timers(nullptr), log(nullptr), logId(0) {}
+
+Character::~Character() = default; // unique_ptr members need the complete types, hence defined here
+
+void Character::attack(Character& target) {
+    useAbility(meleeAttackId, target);
+}
+
+// Checks the name before taking the id path, so an ability whose name hashes
+// to the same id is not used in its place
+void Character::useAbility(const std::string& abilityName, Character& target) {
+    AbilityId id = abilityIdOf(abilityName);
+    if (findAbility(abilityName)) {
+        useAbility(id, target);
+    } else if (log) {
+        log->recordAbility(*this, id, target, false);
+    }
+}
+
+void Character::useAbility(AbilityId id, Character& target) {
+    const Ability* ability = beginAbility(id);
+    if (log) {
+        log->recordAbility(*this, id, target, ability != nullptr);
+    }
+    if (ability) {
+        ability->activate(*this, target);
+    }
+}
+
+const Ability* Character::beginAbility(AbilityId id) {
+    const Ability* ability = findAbility(id);
+    if (!ability || !isReady(id) || !isAlive() || !consumeMana(ability->resourceCost)) {
+        return nullptr;
+    }
+    if (timers && ability->cooldown > 0) {
+        timers->startCooldown(*this, *ability, ability->cooldown);
+    }
+    return ability;
+}
+
+const Character::DerivedStats& Character::derivedStats() const {
+    if (statsDirty) {
+        stats.level = level;
+        stats.damageBonusPercent = 0;
+        stats.vulnerabilityPercent = 0;
+        for (const Ability* effect : activeEffects) {
+            if (effect->kind == AbilityKind::Buff) {
+                stats.damageBonusPercent += buffDamageBonusPercent;
+            } else if (effect->kind == AbilityKind::Debuff) {
+                stats.vulnerabilityPercent += debuffVulnerabilityPercent;
+            }
+        }
+        bool armored;
+        if (world && world->isValid(entity)) {
+            armored = world->health.kind[world->slotOf(entity)] == HealthKind::Armored;
+        } else {
+            armored = dynamic_cast<const ArmoredHealth*>(health.get()) != nullptr;
+        }
+        stats.armorPercent = armored ? ArmoredHealth::damageReductionPercent : 0;
+        statsDirty = false;
+    }
+    return stats;
+}
+
+void Character::setLevel(int newLevel) {
+    level = newLevel;
+    markStatsDirty();
+}
+
+void Character::reset(const std::string& newName, int newLevel) {
+    name = newName;
+    level = newLevel;
+    abilities.clear();
+    activeEffects.clear();
+    learnedAbilities.clear();
+    coolingDown.clear();
+    abilityTable.clear();
+    indexedAbilityCount = 0;
+    indexedLearnedCount = 0;
+    world = nullptr;
+    entity = invalidEntity;
+    position = Position{0.0f, 0.0f};
+    facing = Position{1.0f, 0.0f};
+    timers = nullptr;
+    log = nullptr;
+    logId = 0;
+    markStatsDirty();
+}
+
+void Character::learnAbility(const Ability& definition) {
+    learnedAbilities.push_back(&definition);
+}
+
+bool Character::isReady(AbilityId id) const {
+    return std::find(coolingDown.begin(), coolingDown.end(), id) == coolingDown.end();
+}
+
+void Character::setReady(AbilityId id, bool ready) {
+    auto it = std::find(coolingDown.begin(), coolingDown.end(), id);
+    if (ready && it != coolingDown.end()) {
+        *it = coolingDown.back();
+        coolingDown.pop_back();
+    } else if (!ready && it == coolingDown.end()) {
+        coolingDown.push_back(id);
+    }
+}
+
+// The string form hashes once and checks the name, in case of an id clash
+const Ability* Character::findAbility(const std::string& abilityName) {
+    const Ability* ability = findAbility(abilityIdOf(abilityName));
+    return ability && ability->name == abilityName ? ability : nullptr;
+}
+
+const Ability* Character::findAbility(AbilityId id) {
+    if (indexedAbilityCount != abilities.size() || indexedLearnedCount != learnedAbilities.size()) {
+        rebuildAbilityTable();
+    }
+    if (abilityTable.empty()) {
+        return nullptr;
+    }
+    std::size_t mask = abilityTable.size() - 1;
+    for (std::size_t i = id & mask;; i = (i + 1) & mask) {
+        const AbilitySlot& slot = abilityTable[i];
+        if (!slot.ability) {
+            return nullptr;
+        }
+        if (slot.id == id) {
+            return slot.ability;
+        }
+    }
+}
+
+// Sized to at most half full so probes stay short; the first ability with a
+// given id wins
+void Character::rebuildAbilityTable() {
+    std::size_t capacity = 4;
+    while (capacity < (abilities.size() + learnedAbilities.size()) * 2) {
+        capacity *= 2;
+    }
+    abilityTable.assign(capacity, AbilitySlot{0, nullptr});
+    std::size_t mask = capacity - 1;
+    auto index = [&](const Ability* ability) {
+        std::size_t i = ability->id & mask;
+        while (abilityTable[i].ability && abilityTable[i].id != ability->id) {
+            i = (i + 1) & mask;
+        }
+        if (!abilityTable[i].ability) {
+            abilityTable[i] = AbilitySlot{ability->id, ability};
+        }
+    };
+    for (auto& ability : abilities) {
+        index(ability.get());
+    }
+    for (const Ability* ability : learnedAbilities) {
+        index(ability);
+    }
+    indexedAbilityCount = abilities.size();
+    indexedLearnedCount = learnedAbilities.size();
+}
+
+void Character::takeDamage(int amount) {
+    if (world) {
+        world->takeDamage(entity, amount);
+    } else if (health) {
+        health->takeDamage(amount);
+    }
+    if (log) {
+        log->record(CombatEvent{0, logId, logId, 0, amount, healthOf(*this), CombatEvent::Kind::TakeDamage, 0});
+    }
+}
+
+void Character::heal(int amount) {
+    if (world) {
+        world->heal(entity, amount);
+    } else if (health) {
+        health->heal(amount);
+    }
+    if (log) {
+        log->record(CombatEvent{0, logId, logId, 0, amount, healthOf(*this), CombatEvent::Kind::Heal, 0});
+    }
+}
+
+bool Character::isAlive() const {
+    if (world) {
+        return world->isAlive(entity);
+    }
+    return health && health->isAlive();
+}
+
+bool Character::consumeMana(int amount) {
+    bool paid;
+    if (world) {
+        paid = world->consumeMana(entity, amount);
+    } else {
+        paid = !mana || mana->consumeMana(amount);
+    }
+    if (log) {
+        log->record(CombatEvent{0, logId, logId, 0, amount, paid ? 1 : 0, CombatEvent::Kind::ConsumeMana, 0});
+    }
+    return paid;
+}
+
+void Character::regenerateMana(int amount) {
+    if (world) {
+        world->regenerateMana(entity, amount);
+    } else if (mana) {
+        mana->regenerateMana(amount);
+    }
+}
+
+// --- Health Components ---
+
+HealthComponent::HealthComponent(int maxHp) : currentHealth(maxHp), maxHealth(maxHp) {}
+
+void HealthComponent::heal(int amount) {
+    currentHealth = std::min(maxHealth, currentHealth + amount);
+}
+
+bool HealthComponent::isAlive() const {
+    return currentHealth > 0;
+}
+
+StandardHealth::StandardHealth(int maxHp) : HealthComponent(maxHp) {}
+
+void StandardHealth::takeDamage(int amount) {
+    GAME_SPAN("HealthComponent::takeDamage");
+    GAME_COUNT("combat.damage_taken", amount);
+    currentHealth = std::max(0, currentHealth - amount);
+}
+
+ArmoredHealth::ArmoredHealth(int maxHp) : HealthComponent(maxHp) {}
+
+void ArmoredHealth::takeDamage(int amount) {
+    GAME_SPAN("HealthComponent::takeDamage");
+    GAME_COUNT("combat.damage_taken", mitigate(amount));
+    currentHealth = std::max(0, currentHealth - mitigate(amount));
+}
+
+// --- Mana/Resource Components ---
+
+ManaComponent::ManaComponent(int maxResource) : currentMana(maxResource), maxMana(maxResource) {}
+
+ArcaneMana::ArcaneMana(int maxResource) : ManaComponent(maxResource) {}
+
+bool ArcaneMana::consumeMana(int amount) {
+    if (currentMana < amount) {
+        return false;
+    }
+    currentMana -= amount;
+    return true;
+}
+
+void ArcaneMana::regenerateMana(int amount) {
+    currentMana = std::min(maxMana, currentMana + amount);
+}
+
+// Rage starts empty and is built up in combat
+RageEnergy::RageEnergy(int maxResource) : ManaComponent(maxResource) {
+    currentMana = 0;
+}
+
+bool RageEnergy::consumeMana(int amount) {
+    if (currentMana < amount) {
+        return false;
+    }
+    currentMana -= amount;
+    return true;
+}
+
+void RageEnergy::regenerateMana(int amount) {
+    currentMana = std::max(0, std::min(maxMana, currentMana + amount));
+}
+
+// --- Ability Classes ---
+
+Ability::Ability(const std::string& name, AbilityKind kind, int cost, DamageCalculator* dc, TargetSelection* ts)
+    : name(name), id(abilityIdOf(name)), spanDetail(instrumentation::internDetail(name.c_str())), kind(kind),
+      resourceCost(cost), cooldown(0), damageCalculator(dc), targetSelection(ts) {}
+
+MeleeAttack::MeleeAttack(int baseDmg, DamageCalculator* dc, TargetSelection* ts)
+    : Ability("Melee Attack", AbilityKind::Melee, 0, dc, ts), baseDamage(baseDmg) {}
+
+void MeleeAttack::activate(Character& caster, Character& target) const {
+    GAME_SPAN_DETAIL("Ability::activate", spanDetail);
+    GAME_COUNT("combat.activations", 1);
+    int damage = damageCalculator ? damageCalculator->calculateDamage(*this, caster, target) : baseDamage;
+    target.takeDamage(damage);
+}
+
+SpellCast::SpellCast(const std::string& effect, DamageCalculator* dc, TargetSelection* ts)
+    : Ability(effect, AbilityKind::Spell, spellResourceCost, dc, ts), spellEffect(effect), baseDamage(spellBaseDamage) {}
+
+void SpellCast::activate(Character& caster, Character& target) const {
+    GAME_SPAN_DETAIL("Ability::activate", spanDetail);
+    GAME_COUNT("combat.activations", 1);
+    int damage = damageCalculator ? damageCalculator->calculateDamage(*this, caster, target) : baseDamage;
+    target.takeDamage(damage);
+}
+
+Buff::Buff(const std::string& description, int dur)
+    : Ability(description, AbilityKind::Buff, 0, nullptr, nullptr), effectDescription(description), duration(dur) {}
+
+// Expires on the target's timers when it has them, so the effect ends
+// wherever the target is ticked
+void Buff::activate(Character& caster, Character& target) const {
+    GAME_SPAN_DETAIL("Ability::activate", spanDetail);
+    GAME_COUNT("combat.activations", 1);
+    apply(target);
+    CombatTimers* timers = target.timers ? target.timers : caster.timers;
+    if (timers && duration > 0) {
+        timers->scheduleEffectExpiry(*this, target, duration);
+    }
+}
+
+void Buff::apply(Character& target) const {
+    target.activeEffects.push_back(this);
+    target.markStatsDirty();
+}
+
+void Buff::remove(Character& target) const {
+    auto it = std::find(target.activeEffects.begin(), target.activeEffects.end(), this);
+    if (it != target.activeEffects.end()) {
+        target.activeEffects.erase(it);
+        target.markStatsDirty();
+    }
+}
+
+Debuff::Debuff(const std::string& description, int dur)
+    : Ability(description, AbilityKind::Debuff, 0, nullptr, nullptr), effectDescription(description), duration(dur) {}
+
+// Expires on the target's timers when it has them, so the effect ends
+// wherever the target is ticked
+void Debuff::activate(Character& caster, Character& target) const {
+    GAME_SPAN_DETAIL("Ability::activate", spanDetail);
+    GAME_COUNT("combat.activations", 1);
+    apply(target);
+    CombatTimers* timers = target.timers ? target.timers : caster.timers;
+    if (timers && duration > 0) {
+        timers->scheduleEffectExpiry(*this, target, duration);
+    }
+}
+
+void Debuff::apply(Character& target) const {
+    target.activeEffects.push_back(this);
+    target.markStatsDirty();
+}
+
+void Debuff::remove(Character& target) const {
+    auto it = std::find(target.activeEffects.begin(), target.activeEffects.end(), this);
+    if (it != target.activeEffects.end()) {
+        target.activeEffects.erase(it);
+        target.markStatsDirty();
+    }
+}
+
+// --- Utility Classes ---
+
+// base + 10% per caster level, +10% per Buff on the caster and per Debuff on
+// the target. Integer math only, so results are the same on every platform.
+// The modifiers come from both characters' cached DerivedStats.
+int DamageCalculator::calculateDamage(const Ability& ability, const Character& caster, const Character& target) {
+    GAME_SPAN_DETAIL("DamageCalculator::calculateDamage", ability.spanDetail);
+    const Character::DerivedStats& attacker = caster.derivedStats();
+    const Character::DerivedStats& defender = target.derivedStats();
+    return scaleDamage(abilityBaseDamage(ability), attacker.level,
+                       attacker.damageBonusPercent + defender.vulnerabilityPercent);
+}
+
+// Neither instruction set has integer division, so the vector paths divide
+// by 10 and 100 with the exact multiply-and-shift reciprocals compilers use
+// for unsigned 32-bit values: x / 10 == (x * 0xCCCCCCCD) >> 35 and
+// x / 100 == (x * 0x51EB851F) >> 37 for every x below 2^32. For
+// non-negative inputs that equals the scalar code's signed division.
+namespace {
+#if defined(__AVX2__)
+template <std::uint32_t Magic, int Shift>
+inline __m256i divideEpu32(__m256i x) {
+    const __m256i magic = _mm256_set1_epi32(static_cast<int>(Magic));
+    __m256i even = _mm256_srli_epi64(_mm256_mul_epu32(x, magic), Shift);
+    __m256i odd = _mm256_srli_epi64(_mm256_mul_epu32(_mm256_srli_epi64(x, 32), magic), Shift);
+    return _mm256_blend_epi32(even, _mm256_slli_epi64(odd, 32), 0xAA);
+}
+#elif defined(__ARM_NEON)
+template <std::uint32_t Magic, int Shift>
+inline uint32x4_t divideU32(uint32x4_t x) {
+    const uint32x2_t magic = vdup_n_u32(Magic);
+    uint64x2_t low = vshrq_n_u64(vmull_u32(vget_low_u32(x), magic), Shift);
+    uint64x2_t high = vshrq_n_u64(vmull_u32(vget_high_u32(x), magic), Shift);
+    return vcombine_u32(vmovn_u64(low), vmovn_u64(high));
+}
+#endif
+}
+
+void DamageCalculator::calculateDamageBatch(const int* baseDamage, const int* casterLevel, const int* bonusPercent,
+                                            const int* armorPercent, int* out, std::size_t count) {
+    std::size_t i = 0;
+#if defined(__AVX2__)
+    for (; i + 8 <= count; i += 8) {
+        __m256i base = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(baseDamage + i));
+        __m256i level = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(casterLevel + i));
+        __m256i bonus = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(bonusPercent + i));
+        __m256i armor = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(armorPercent + i));
+        __m256i scaled = _mm256_add_epi32(base, divideEpu32<0xCCCCCCCDu, 35>(_mm256_mullo_epi32(base, level)));
+        __m256i damage = _mm256_add_epi32(scaled, divideEpu32<0x51EB851Fu, 37>(_mm256_mullo_epi32(scaled, bonus)));
+        __m256i dealt = _mm256_sub_epi32(damage, divideEpu32<0x51EB851Fu, 37>(_mm256_mullo_epi32(damage, armor)));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i), dealt);
+    }
+#elif defined(__ARM_NEON)
+    for (; i + 4 <= count; i += 4) {
+        uint32x4_t base = vreinterpretq_u32_s32(vld1q_s32(baseDamage + i));
+        uint32x4_t level = vreinterpretq_u32_s32(vld1q_s32(casterLevel + i));
+        uint32x4_t bonus = vreinterpretq_u32_s32(vld1q_s32(bonusPercent + i));
+        uint32x4_t armor = vreinterpretq_u32_s32(vld1q_s32(armorPercent + i));
+        uint32x4_t scaled = vaddq_u32(base, divideU32<0xCCCCCCCDu, 35>(vmulq_u32(base, level)));
+        uint32x4_t damage = vaddq_u32(scaled, divideU32<0x51EB851Fu, 37>(vmulq_u32(scaled, bonus)));
+        uint32x4_t dealt = vsubq_u32(damage, divideU32<0x51EB851Fu, 37>(vmulq_u32(damage, armor)));
+        vst1q_s32(out + i, vreinterpretq_s32_u32(dealt));
+    }
+#endif
+    for (; i < count; ++i) {
+        int damage = scaleDamage(baseDamage[i], casterLevel[i], bonusPercent[i]);
+        out[i] = damage - damage * armorPercent[i] / 100;
+    }
+}
+
+TargetType parseTargetType(const std::string& targetType) {
+    if (targetType == "self") {
+        return TargetType::Self;
+    }
+    if (targetType == "area") {
+        return TargetType::Area;
+    }
+    if (targetType == "cone") {
+        return TargetType::Cone;
+    }
+    return TargetType::Single;
+}
+
+std::vector<Character*> TargetSelection::selectTargets(Character& caster, const Ability& ability) {
+    return selectTargets(caster, ability, "single");
+}
+
+std::vector<Character*> TargetSelection::selectTargets(Character& caster, const Ability& ability, const std::string& targetType) {
+    // Room for every character the query could return, as without a grid
+    std::vector<Character*> targets((grid ? grid->size() : candidates.size()) + 1);
+    targets.resize(selectTargets(caster, ability, parseTargetType(targetType), targets.data(), targets.size()));
+    return targets;
+}
+
+std::size_t TargetSelection::selectTargets(Character& caster, const Ability& ability, const std::string& targetType,
+                                           Character** out, std::size_t capacity) {
+    return selectTargets(caster, ability, parseTargetType(targetType), out, capacity);
+}
+
+// Self targets the caster. Without a grid, Single is the first living
+// candidate other than the caster and Area/Cone every living candidate other
+// than the caster; with a grid, targeting is by distance (see the header).
+std::size_t TargetSelection::selectTargets(Character& caster, [[maybe_unused]] const Ability& ability,
+                                           TargetType targetType, Character** out, std::size_t capacity) {
+    GAME_SPAN_DETAIL("TargetSelection::selectTargets", ability.spanDetail);
+    GAME_COUNT("combat.target_queries", 1);
+    if (capacity == 0) {
+        return 0;
+    }
+    if (targetType == TargetType::Self) {
+        out[0] = &caster;
+        return 1;
+    }
+    if (grid) {
+        switch (targetType) {
+            case TargetType::Single:
+                return grid->queryNearest(caster.position, range, &caster, out, 1);
+            case TargetType::Cone:
+                return grid->queryCone(caster.position, caster.facing, range, coneHalfAngleCos, &caster, out, capacity);
+            default:
+                return grid->queryRadius(caster.position, range, &caster, out, capacity);
+        }
+    }
+    std::size_t written = 0;
+    for (Character* candidate : candidates) {
+        if (candidate == &caster || !candidate->isAlive()) {
+            continue;
+        }
+        out[written++] = candidate;
+        if (targetType == TargetType::Single || written == capacity) {
+            break;
+        }
+    }
+    return written;
+}
+
+const Ability& AbilityRegistry::add(std::unique_ptr<Ability> definition) {
+    auto found = byId.find(definition->id);
+    if (found != byId.end()) {
+        return *found->second;
+    }
+    definitions.push_back(std::move(definition));
+    byId.emplace(definitions.back()->id, definitions.back().get());
+    return *definitions.back();
+}
+
+const Ability* AbilityRegistry::find(AbilityId id) const {
+    auto found = byId.find(id);
+    return found == byId.end() ? nullptr : found->second;
+}
+
+const Ability* AbilityRegistry::find(const std::string& name) const {
+    const Ability* ability = find(abilityIdOf(name));
+    return ability && ability->name == name ? ability : nullptr;
+}
+
+// --- Spatial Index ---
+
+namespace {
+float distanceSquared(Position a, Position b) {
+    float dx = a.x - b.x;
+    float dy = a.y - b.y;
+    return dx * dx + dy * dy;
+}
+}
+
+SpatialGrid::SpatialGrid(float cellSize) : cellSize(cellSize), inverseCellSize(1.0f / cellSize) {}
+
+int SpatialGrid::cellCoordinate(float value) const {
+    return static_cast<int>(std::floor(value * inverseCellSize));
+}
+
+// Shifted as unsigned: left-shifting a negative coordinate is undefined
+std::int64_t SpatialGrid::cellKey(int cellX, int cellY) {
+    return static_cast<std::int64_t>(static_cast<std::uint64_t>(static_cast<std::uint32_t>(cellX)) << 32 |
+                                     static_cast<std::uint32_t>(cellY));
+}
+
+std::int64_t SpatialGrid::cellKeyOf(Position position) const {
+    return cellKey(cellCoordinate(position.x), cellCoordinate(position.y));
+}
+
+const std::vector<Character*>* SpatialGrid::cellAt(int cellX, int cellY) const {
+    auto it = cells.find(cellKey(cellX, cellY));
+    return it == cells.end() ? nullptr : &it->second;
+}
+
+void SpatialGrid::insert(Character& character) {
+    cells[cellKeyOf(character.position)].push_back(&character);
+    ++count;
+}
+
+void SpatialGrid::remove(Character& character) {
+    auto it = cells.find(cellKeyOf(character.position));
+    if (it == cells.end()) {
+        return;
+    }
+    std::vector<Character*>& cell = it->second;
+    auto found = std::find(cell.begin(), cell.end(), &character);
+    if (found != cell.end()) {
+        *found = cell.back();
+        cell.pop_back();
+        --count;
+    }
+    // Empty cells are kept so characters moving back and forth don't reallocate
+}
+
+void SpatialGrid::move(Character& character, Position newPosition) {
+    if (cellKeyOf(newPosition) != cellKeyOf(character.position)) {
+        remove(character);
+        character.position = newPosition;
+        insert(character);
+    } else {
+        character.position = newPosition;
+    }
+}
+
+std::size_t SpatialGrid::queryRadius(Position center, float radius, const Character* exclude,
+                                     Character** out, std::size_t capacity) const {
+    float radiusSquared = radius * radius;
+    std::size_t written = 0;
+    for (int cellX = cellCoordinate(center.x - radius), lastX = cellCoordinate(center.x + radius); cellX <= lastX; ++cellX) {
+        for (int cellY = cellCoordinate(center.y - radius), lastY = cellCoordinate(center.y + radius); cellY <= lastY; ++cellY) {
+            const std::vector<Character*>* cell = cellAt(cellX, cellY);
+            if (!cell) {
+                continue;
+            }
+            for (Character* character : *cell) {
+                if (character == exclude || distanceSquared(character->position, center) > radiusSquared || !character->isAlive()) {
+                    continue;
+                }
+                out[written++] = character;
+                if (written == capacity) {
+                    return written;
+                }
+            }
+        }
+    }
+    return written;
+}
+
+std::size_t SpatialGrid::queryCone(Position origin, Position direction, float range, float minCos,
+                                   const Character* exclude, Character** out, std::size_t capacity) const {
+    float rangeSquared = range * range;
+    std::size_t written = 0;
+    for (int cellX = cellCoordinate(origin.x - range), lastX = cellCoordinate(origin.x + range); cellX <= lastX; ++cellX) {
+        for (int cellY = cellCoordinate(origin.y - range), lastY = cellCoordinate(origin.y + range); cellY <= lastY; ++cellY) {
+            const std::vector<Character*>* cell = cellAt(cellX, cellY);
+            if (!cell) {
+                continue;
+            }
+            for (Character* character : *cell) {
+                if (character == exclude) {
+                    continue;
+                }
+                float dx = character->position.x - origin.x;
+                float dy = character->position.y - origin.y;
+                float lengthSquared = dx * dx + dy * dy;
+                float along = dx * direction.x + dy * direction.y;
+                // along >= minCos * length, compared squared to avoid a sqrt
+                bool inCone = along >= 0.0f ? (minCos <= 0.0f || along * along >= minCos * minCos * lengthSquared)
+                                            : (minCos < 0.0f && along * along <= minCos * minCos * lengthSquared);
+                if (lengthSquared > rangeSquared || !inCone || !character->isAlive()) {
+                    continue;
+                }
+                out[written++] = character;
+                if (written == capacity) {
+                    return written;
+                }
+            }
+        }
+    }
+    return written;
+}
+
+// Searches square rings of cells outward from the center, keeping the best
+// candidates sorted in out, and stops once no unvisited cell can be closer
+// than the current capacity-th best
+std::size_t SpatialGrid::queryNearest(Position center, float maxRadius, const Character* exclude,
+                                      Character** out, std::size_t capacity) const {
+    if (capacity == 0) {
+        return 0;
+    }
+    float maxRadiusSquared = maxRadius * maxRadius;
+    int centerX = cellCoordinate(center.x);
+    int centerY = cellCoordinate(center.y);
+    int maxRing = static_cast<int>(std::ceil(maxRadius * inverseCellSize)) + 1;
+    std::size_t written = 0;
+
+    auto consider = [&](Character* character) {
+        if (character == exclude) {
+            return;
+        }
+        float distance = distanceSquared(character->position, center);
+        if (distance > maxRadiusSquared || !character->isAlive()) {
+            return;
+        }
+        if (written == capacity && distance >= distanceSquared(out[written - 1]->position, center)) {
+            return;
+        }
+        std::size_t at = written < capacity ? written++ : written - 1;
+        // Insertion into the sorted buffer
+        while (at > 0 && distanceSquared(out[at - 1]->position, center) > distance) {
+            out[at] = out[at - 1];
+            --at;
+        }
+        out[at] = character;
+    };
+
+    for (int ring = 0; ring <= maxRing; ++ring) {
+        if (written == capacity) {
+            // Every cell in this ring is at least (ring - 1) cells away from the center
+            float nearestPossible = (ring - 1) * cellSize;
+            if (nearestPossible > 0.0f &&
+                nearestPossible * nearestPossible > distanceSquared(out[written - 1]->position, center)) {
+                break;
+            }
+        }
+        for (int cellX = centerX - ring; cellX <= centerX + ring; ++cellX) {
+            bool edgeColumn = cellX == centerX - ring || cellX == centerX + ring;
+            for (int cellY = centerY - ring; cellY <= centerY + ring; cellY += (edgeColumn || ring == 0) ? 1 : 2 * ring) {
+                if (const std::vector<Character*>* cell = cellAt(cellX, cellY)) {
+                    for (Character* character : *cell) {
+                        consider(character);
+                    }
+                }
+            }
+        }
+    }
+    return written;
+}
+
+// --- Timers ---
+
+namespace {
+void fireTimer(const TimerEvent& event) {
+    if (event.kind == TimerEvent::Kind::CooldownReady) {
+        event.character->setReady(event.ability->id, true);
+    } else if (event.ability->kind == AbilityKind::Buff) {
+        static_cast<const Buff*>(event.ability)->remove(*event.character);
+    } else if (event.ability->kind == AbilityKind::Debuff) {
+        static_cast<const Debuff*>(event.ability)->remove(*event.character);
+    }
+}
+}
+
+TimerWheel::TimerWheel(std::uint32_t capacity) : capacity(std::min(capacity, maxCapacity)) {
+    for (auto& level : heads) {
+        for (std::uint32_t& head : level) {
+            head = none;
+        }
+    }
+}
+
+TimerId TimerWheel::schedule(std::uint32_t delayTicks, const TimerEvent& event) {
+    if (activeCount >= capacity) {
+        return invalidTimer; // Another node would alias an existing handle
+    }
+    std::uint32_t index;
+    if (!freeNodes.empty()) {
+        index = freeNodes.back();
+        freeNodes.pop_back();
+    } else {
+        index = static_cast<std::uint32_t>(nodes.size());
+        nodes.push_back(Node{0, event, none, none, 0, false});
+        location.push_back(0);
+    }
+    Node& node = nodes[index];
+    node.expiry = currentTick + (delayTicks == 0 ? 1 : delayTicks);
+    node.event = event;
+    node.active = true;
+    place(index);
+    ++activeCount;
+    return (static_cast<TimerId>(node.generation) << indexBits) | index;
+}
+
+bool TimerWheel::cancel(TimerId id) {
+    std::uint32_t index = id & indexMask;
+    if (id == invalidTimer || index >= nodes.size() || !nodes[index].active ||
+        nodes[index].generation != (id >> indexBits)) {
+        return false;
+    }
+    unlink(index);
+    release(index);
+    return true;
+}
+
+// Level l holds timers due within 64^(l+1) ticks, in the slot given by
+// their expiry's l-th base-64 digit
+void TimerWheel::place(std::uint32_t index) {
+    Tick expiry = nodes[index].expiry;
+    Tick delta = expiry > currentTick ? expiry - currentTick : 0;
+    int level = 0;
+    while (level < levelCount - 1 && delta >= (Tick(1) << (slotBits * (level + 1)))) {
+        ++level;
+    }
+    link(index, level, static_cast<std::uint32_t>((expiry >> (slotBits * level)) & (slotCount - 1)));
+}
+
+void TimerWheel::link(std::uint32_t index, int level, std::uint32_t slot) {
+    Node& node = nodes[index];
+    std::uint32_t& head = heads[level][slot];
+    node.prev = none;
+    node.next = head;
+    if (head != none) {
+        nodes[head].prev = index;
+    }
+    head = index;
+    location[index] = static_cast<std::uint16_t>(level * slotCount + slot);
+}
+
+void TimerWheel::unlink(std::uint32_t index) {
+    Node& node = nodes[index];
+    if (node.prev != none) {
+        nodes[node.prev].next = node.next;
+    } else {
+        heads[location[index] / slotCount][location[index] % slotCount] = node.next;
+    }
+    if (node.next != none) {
+        nodes[node.next].prev = node.prev;
+    }
+}
+
+std::uint32_t TimerWheel::detachSlot(int level, std::uint32_t slot) {
+    std::uint32_t head = heads[level][slot];
+    heads[level][slot] = none;
+    return head;
+}
+
+// Moves the timers of the level slot that just came into range down to
+// lower levels
+void TimerWheel::cascade(int level) {
+    std::uint32_t slot = static_cast<std::uint32_t>((currentTick >> (slotBits * level)) & (slotCount - 1));
+    std::uint32_t index = detachSlot(level, slot);
+    while (index != none) {
+        std::uint32_t next = nodes[index].next;
+        place(index);
+        index = next;
+    }
+}
+
+void TimerWheel::release(std::uint32_t index) {
+    Node& node = nodes[index];
+    node.active = false;
+    ++node.generation; // Stale TimerIds no longer match
+    freeNodes.push_back(index);
+    --activeCount;
+}
+
+TimerId CombatTimers::startCooldown(Character& owner, const Ability& ability, int ticks) {
+    TimerId id = wheel.schedule(static_cast<std::uint32_t>(ticks), TimerEvent{TimerEvent::Kind::CooldownReady, &ability, &owner});
+    if (id != invalidTimer) {
+        owner.setReady(ability.id, false);
+    }
+    return id;
+}
+
+TimerId CombatTimers::scheduleEffectExpiry(const Ability& effect, Character& target, int ticks) {
+    return wheel.schedule(static_cast<std::uint32_t>(ticks), TimerEvent{TimerEvent::Kind::RemoveEffect, &effect, &target});
+}
+
+bool CombatTimers::cancel(TimerId id) {
+    return wheel.cancel(id);
+}
+
+void CombatTimers::tick() {
+    wheel.advance(fireTimer);
+}
+
+void CombatTimers::expireAll() {
+    wheel.expireAll(fireTimer);
+}
+
+// --- Encounter Scheduling ---
+
+WorkStealingPool::WorkStealingPool(unsigned threadCount) {
+    if (threadCount == 0) {
+        threadCount = std::max(1u, std::thread::hardware_concurrency());
+    }
+    for (unsigned i = 0; i < threadCount; ++i) {
+        queues.push_back(std::make_unique<TaskQueue>());
+    }
+    for (unsigned i = 1; i < threadCount; ++i) {
+        workers.emplace_back(&WorkStealingPool::workerLoop, this, i);
+    }
+}
+
+WorkStealingPool::~WorkStealingPool() {
+    {
+        std::lock_guard<std::mutex> lock(stateMutex);
+        stopping = true;
+    }
+    wake.notify_all();
+    for (std::thread& worker : workers) {
+        worker.join();
+    }
+}
+
+// current is published before any task is queued, so a worker that finds a
+// task always sees the function it belongs to
+void WorkStealingPool::run(std::size_t taskCount, const std::function<void(std::size_t)>& task) {
+    if (taskCount == 0) {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(stateMutex);
+        current = &task;
+        remaining = taskCount;
+        ++runGeneration;
+    }
+    for (std::size_t i = 0; i < taskCount; ++i) {
+        TaskQueue& queue = *queues[i % queues.size()];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        queue.tasks.push_back(i);
+    }
+    wake.notify_all();
+
+    work(0);
+    std::unique_lock<std::mutex> lock(stateMutex);
+    done.wait(lock, [this] { return remaining == 0; });
+    current = nullptr;
+}
+
+void WorkStealingPool::workerLoop(unsigned self) {
+    std::uint64_t seenGeneration = 0;
+    for (;;) {
+        {
+            std::unique_lock<std::mutex> lock(stateMutex);
+            wake.wait(lock, [&] { return stopping || runGeneration != seenGeneration; });
+            if (stopping) {
+                return;
+            }
+            seenGeneration = runGeneration;
+        }
+        work(self);
+    }
+}
+
+void WorkStealingPool::work(unsigned self) {
+    std::size_t task;
+    while (take(self, task)) {
+        (*current)(task);
+        std::lock_guard<std::mutex> lock(stateMutex);
+        if (--remaining == 0) {
+            done.notify_all();
+        }
+    }
+}
+
+bool WorkStealingPool::take(unsigned self, std::size_t& task) {
+    {
+        TaskQueue& own = *queues[self];
+        std::lock_guard<std::mutex> lock(own.mutex);
+        if (!own.tasks.empty()) {
+            task = own.tasks.back();
+            own.tasks.pop_back();
+            return true;
+        }
+    }
+    for (std::size_t offset = 1; offset < queues.size(); ++offset) {
+        TaskQueue& victim = *queues[(self + offset) % queues.size()];
+        std::lock_guard<std::mutex> lock(victim.mutex);
+        if (!victim.tasks.empty()) {
+            task = victim.tasks.front();
+            victim.tasks.pop_front();
+            return true;
+        }
+    }
+    return false;
+}
+
+bool CombatGroup::contains(const Character& character) const {
+    return scheduler && scheduler->groupOf(character) == index;
+}
+
+void CombatGroup::damage(Character& target, int amount) {
+    if (contains(target)) {
+        target.takeDamage(amount);
+    } else {
+        deferred.push_back(DeferredCommand{DeferredCommand::Kind::Damage, nullptr, &target, nullptr, amount});
+    }
+}
+
+void CombatGroup::heal(Character& target, int amount) {
+    if (contains(target)) {
+        target.heal(amount);
+    } else {
+        deferred.push_back(DeferredCommand{DeferredCommand::Kind::Heal, nullptr, &target, nullptr, amount});
+    }
+}
+
+// The caster pays for a cross-group ability here; its effect waits for the
+// barrier, where it reads and writes the target's group safely
+void CombatGroup::tick() {
+    for (const CombatAction& action : actions) {
+        if (contains(*action.target)) {
+            action.caster->useAbility(action.ability, *action.target);
+        } else {
+            const Ability* ability = action.caster->beginAbility(action.ability);
+            if (action.caster->log) {
+                action.caster->log->recordAbility(*action.caster, action.ability, *action.target, ability != nullptr);
+            }
+            if (ability) {
+                deferred.push_back(DeferredCommand{DeferredCommand::Kind::Ability, action.caster, action.target, ability, 0});
+            }
+        }
+    }
+    actions.clear();
+    timers.tick();
+}
+
+EncounterScheduler::EncounterScheduler(unsigned threadCount) : pool(threadCount) {}
+
+namespace {
+std::size_t findRoot(std::vector<std::size_t>& parent, std::size_t i) {
+    while (parent[i] != i) {
+        parent[i] = parent[parent[i]];
+        i = parent[i];
+    }
+    return i;
+}
+}
+
+// Union-find over the engagements; groups are numbered by their first
+// member's position in characters, so the grouping is itself deterministic
+void EncounterScheduler::partition(const std::vector<Character*>& characters,
+                                   const std::vector<std::pair<Character*, Character*>>& engagements) {
+    for (auto& group : groups) {
+        group->timers.expireAll();
+        for (Character* member : group->members) {
+            member->timers = nullptr;
+        }
+    }
+    groups.clear();
+    groupIndex.clear();
+
+    std::unordered_map<const Character*, std::size_t> position;
+    position.reserve(characters.size());
+    for (std::size_t i = 0; i < characters.size(); ++i) {
+        position.emplace(characters[i], i);
+    }
+    std::vector<std::size_t> parent(characters.size());
+    for (std::size_t i = 0; i < parent.size(); ++i) {
+        parent[i] = i;
+    }
+    for (const auto& engagement : engagements) {
+        auto first = position.find(engagement.first);
+        auto second = position.find(engagement.second);
+        if (first == position.end() || second == position.end()) {
+            continue;
+        }
+        std::size_t a = findRoot(parent, first->second);
+        std::size_t b = findRoot(parent, second->second);
+        if (a != b) {
+            parent[std::max(a, b)] = std::min(a, b);
+        }
+    }
+
+    std::vector<std::uint32_t> groupOfRoot(characters.size(), noGroup);
+    groupIndex.reserve(characters.size());
+    for (std::size_t i = 0; i < characters.size(); ++i) {
+        std::size_t root = findRoot(parent, i);
+        if (groupOfRoot[root] == noGroup) {
+            groupOfRoot[root] = static_cast<std::uint32_t>(groups.size());
+            groups.push_back(std::make_unique<CombatGroup>());
+            groups.back()->index = groupOfRoot[root];
+            groups.back()->scheduler = this;
+        }
+        CombatGroup& group = *groups[groupOfRoot[root]];
+        group.members.push_back(characters[i]);
+        characters[i]->timers = &group.timers;
+        groupIndex.emplace(characters[i], group.index);
+    }
+}
+
+std::uint32_t EncounterScheduler::groupOf(const Character& character) const {
+    auto it = groupIndex.find(&character);
+    return it == groupIndex.end() ? noGroup : it->second;
+}
+
+void EncounterScheduler::queueAction(Character& caster, AbilityId ability, Character& target) {
+    groups[groupOf(caster)]->actions.push_back(CombatAction{&caster, ability, &target});
+}
+
+void EncounterScheduler::tick() {
+    pool.run(groups.size(), [this](std::size_t i) { groups[i]->tick(); });
+    for (auto& group : groups) {
+        for (const DeferredCommand& command : group->deferred) {
+            applyDeferred(command);
+        }
+        group->deferred.clear();
+    }
+}
+
+void EncounterScheduler::applyDeferred(const DeferredCommand& command) {
+    switch (command.kind) {
+        case DeferredCommand::Kind::Ability:
+            command.ability->activate(*command.caster, *command.target);
+            break;
+        case DeferredCommand::Kind::Damage:
+            command.target->takeDamage(command.amount);
+            break;
+        case DeferredCommand::Kind::Heal:
+            command.target->heal(command.amount);
+            break;
+    }
+}
+
+// --- Batch Damage ---
+
+void DamagePipeline::resolve(const HitRecord* hits, std::size_t count) {
+    GAME_SPAN("DamagePipeline::resolve");
+    GAME_COUNT("combat.pipeline_hits", count);
+    gather(hits, count);
+    calculate();
+    apply(hits);
+}
+
+// Reads the scattered object fields once into packed arrays and sorts the
+// hits into per-type index lists, so the later stages don't look at types
+void DamagePipeline::gather(const HitRecord* hits, std::size_t count) {
+    baseDamage.resize(count);
+    casterLevel.resize(count);
+    bonusPercent.resize(count);
+    armorPercent.resize(count);
+    damage.resize(count);
+    worldHits.clear();
+    componentHits.clear();
+
+    for (std::size_t i = 0; i < count; ++i) {
+        const HitRecord& hit = hits[i];
+        const Character::DerivedStats& attacker = hit.caster->derivedStats();
+        const Character::DerivedStats& defender = hit.target->derivedStats();
+        baseDamage[i] = abilityBaseDamage(*hit.ability);
+        casterLevel[i] = attacker.level;
+        bonusPercent[i] = attacker.damageBonusPercent + defender.vulnerabilityPercent;
+        armorPercent[i] = defender.armorPercent;
+
+        // No health anywhere, or a stale entity: damage is computed but not applied
+        if (hit.target->world) {
+            if (hit.target->world->isValid(hit.target->entity)) {
+                worldHits.push_back(static_cast<std::uint32_t>(i));
+            }
+        } else if (hit.target->health) {
+            componentHits.push_back(static_cast<std::uint32_t>(i));
+        }
+    }
+}
+
+void DamagePipeline::calculate() {
+    DamageCalculator::calculateDamageBatch(baseDamage.data(), casterLevel.data(), bonusPercent.data(),
+                                           armorPercent.data(), damage.data(), damage.size());
+}
+
+// Clamped subtraction of non-negative amounts gives the same result in any
+// order, so several hits on one target need no special handling
+void DamagePipeline::apply(const HitRecord* hits) {
+    const int* dealt = damage.data();
+    kills.clear();
+    for (std::uint32_t i : worldHits) {
+        Character& target = *hits[i].target;
+        std::size_t slot = target.world->slotOf(target.entity);
+        int& current = target.world->health.currentHealth[slot];
+        if (current > 0 && current <= dealt[i]) {
+            kills.push_back(hits[i]);
+        }
+        current = std::max(0, current - dealt[i]);
+        target.world->enterCombat(slot);
+        if (target.log) {
+            target.log->record(CombatEvent{0, target.logId, target.logId, 0, dealt[i], current,
+                                           CombatEvent::Kind::TakeDamage, 0});
+        }
+    }
+    for (std::uint32_t i : componentHits) {
+        Character& target = *hits[i].target;
+        int& current = target.health->currentHealth;
+        if (current > 0 && current <= dealt[i]) {
+            kills.push_back(hits[i]);
+        }
+        current = std::max(0, current - dealt[i]);
+        if (target.log) {
+            target.log->record(CombatEvent{0, target.logId, target.logId, 0, dealt[i], current,
+                                           CombatEvent::Kind::TakeDamage, 0});
+        }
+    }
+}
+
+// --- Ability Scripts ---
+
+ScriptedAbility::ScriptedAbility(const std::string& name)
+    : Ability(name, AbilityKind::Scripted, 0, nullptr, nullptr), targetType(TargetType::Single), dealsDamage(false) {}
+
+void ScriptedAbility::activate(Character& caster, Character& target) const {
+    HitRecord cast{&caster, &target, this};
+    activateBatch(&cast, 1);
+}
+
+namespace {
+using ScriptVariable = ScriptedAbility::Variable;
+
+void loadScriptVariable(ScriptVariable variable, const HitRecord* casts, std::size_t count, int* out) {
+    switch (variable) {
+        case ScriptVariable::Level:
+            for (std::size_t i = 0; i < count; ++i) out[i] = casts[i].caster->derivedStats().level;
+            break;
+        case ScriptVariable::TargetLevel:
+            for (std::size_t i = 0; i < count; ++i) out[i] = casts[i].target->derivedStats().level;
+            break;
+        case ScriptVariable::Bonus:
+            for (std::size_t i = 0; i < count; ++i) {
+                out[i] = casts[i].caster->derivedStats().damageBonusPercent +
+                         casts[i].target->derivedStats().vulnerabilityPercent;
+            }
+            break;
+        case ScriptVariable::Health:
+            for (std::size_t i = 0; i < count; ++i) out[i] = healthOf(*casts[i].caster);
+            break;
+        case ScriptVariable::MaxHealth:
+            for (std::size_t i = 0; i < count; ++i) out[i] = maxHealthOf(*casts[i].caster);
+            break;
+        case ScriptVariable::TargetHealth:
+            for (std::size_t i = 0; i < count; ++i) out[i] = healthOf(*casts[i].target);
+            break;
+        case ScriptVariable::TargetMaxHealth:
+            for (std::size_t i = 0; i < count; ++i) out[i] = maxHealthOf(*casts[i].target);
+            break;
+        case ScriptVariable::Mana:
+            for (std::size_t i = 0; i < count; ++i) out[i] = manaOf(*casts[i].caster);
+            break;
+    }
+}
+
+// 64-bit intermediates, so overflowing scripts wrap instead of being undefined
+inline int wrapScript(std::int64_t value) {
+    return static_cast<int>(static_cast<std::uint32_t>(value));
+}
+
+// 32-bit division (much cheaper than 64-bit), with the one overflowing case
+// and division by zero handled
+inline int divideScript(int a, int b) {
+    if (b == 0) {
+        return 0;
+    }
+    return b == -1 ? wrapScript(-std::int64_t{a}) : a / b;
+}
+}
+
+void ScriptedAbility::activateBatch(const HitRecord* casts, std::size_t count, std::vector<HitRecord>* kills) const {
+    GAME_SPAN_DETAIL("Ability::activate", spanDetail);
+    GAME_COUNT("combat.activations", count);
+    int stack[maxStackDepth][lanes];
+    for (std::size_t first = 0; first < count; first += lanes) {
+        const HitRecord* chunk = casts + first;
+        std::size_t n = std::min(lanes, count - first);
+        std::size_t top = 0; // Stack slots in use; the compiler checked the program stays within bounds
+        for (const Instruction& instruction : program) {
+            switch (instruction.op) {
+                case Op::Push: {
+                    int* out = stack[top++];
+                    std::fill(out, out + n, instruction.operand);
+                    break;
+                }
+                case Op::Load:
+                    loadScriptVariable(static_cast<Variable>(instruction.operand), chunk, n, stack[top++]);
+                    break;
+                case Op::Add: {
+                    const int* b = stack[--top];
+                    int* a = stack[top - 1];
+                    for (std::size_t i = 0; i < n; ++i) a[i] = wrapScript(std::int64_t{a[i]} + b[i]);
+                    break;
+                }
+                case Op::Subtract: {
+                    const int* b = stack[--top];
+                    int* a = stack[top - 1];
+                    for (std::size_t i = 0; i < n; ++i) a[i] = wrapScript(std::int64_t{a[i]} - b[i]);
+                    break;
+                }
+                case Op::Multiply: {
+                    const int* b = stack[--top];
+                    int* a = stack[top - 1];
+                    for (std::size_t i = 0; i < n; ++i) a[i] = wrapScript(std::int64_t{a[i]} * b[i]);
+                    break;
+                }
+                case Op::Divide: {
+                    const int* b = stack[--top];
+                    int* a = stack[top - 1];
+                    for (std::size_t i = 0; i < n; ++i) a[i] = divideScript(a[i], b[i]);
+                    break;
+                }
+                case Op::Min: {
+                    const int* b = stack[--top];
+                    int* a = stack[top - 1];
+                    for (std::size_t i = 0; i < n; ++i) a[i] = std::min(a[i], b[i]);
+                    break;
+                }
+                case Op::Max: {
+                    const int* b = stack[--top];
+                    int* a = stack[top - 1];
+                    for (std::size_t i = 0; i < n; ++i) a[i] = std::max(a[i], b[i]);
+                    break;
+                }
+                case Op::AddConstant: {
+                    int* a = stack[top - 1];
+                    for (std::size_t i = 0; i < n; ++i) a[i] = wrapScript(std::int64_t{a[i]} + instruction.operand);
+                    break;
+                }
+                case Op::MultiplyConstant: {
+                    int* a = stack[top - 1];
+                    for (std::size_t i = 0; i < n; ++i) a[i] = wrapScript(std::int64_t{a[i]} * instruction.operand);
+                    break;
+                }
+                case Op::DivideConstant: {
+                    int* a = stack[top - 1];
+                    for (std::size_t i = 0; i < n; ++i) a[i] = divideScript(a[i], instruction.operand);
+                    break;
+                }
+                case Op::Negate: {
+                    int* a = stack[top - 1];
+                    for (std::size_t i = 0; i < n; ++i) a[i] = wrapScript(-std::int64_t{a[i]});
+                    break;
+                }
+                case Op::Damage: {
+                    const int* amount = stack[--top];
+                    for (std::size_t i = 0; i < n; ++i) {
+                        if (amount[i] > 0) {
+                            bool wasAlive = kills && chunk[i].target->isAlive();
+                            chunk[i].target->takeDamage(amount[i]);
+                            if (wasAlive && !chunk[i].target->isAlive()) {
+                                kills->push_back(chunk[i]);
+                            }
+                        }
+                    }
+                    break;
+                }
+                case Op::Heal: {
+                    const int* amount = stack[--top];
+                    for (std::size_t i = 0; i < n; ++i) {
+                        if (amount[i] > 0) {
+                            chunk[i].target->heal(amount[i]);
+                        }
+                    }
+                    break;
+                }
+                case Op::Restore: {
+                    const int* amount = stack[--top];
+                    for (std::size_t i = 0; i < n; ++i) {
+                        chunk[i].caster->regenerateMana(amount[i]);
+                    }
+                    break;
+                }
+                case Op::Effect: {
+                    const Ability& effect = *effects[instruction.operand];
+                    for (std::size_t i = 0; i < n; ++i) {
+                        effect.activate(*chunk[i].caster, *chunk[i].target);
+                    }
+                    break;
+                }
+            }
+        }
+    }
+}
+
+void ScriptedCastBatch::run() {
+    kills.clear();
+    keys.clear();
+    for (std::size_t i = 0; i < casts.size(); ++i) {
+        keys.push_back(static_cast<std::uint64_t>(casts[i].ability->id) << 32 | i);
+    }
+    std::sort(keys.begin(), keys.end());
+    grouped.clear();
+    for (std::uint64_t key : keys) {
+        grouped.push_back(casts[key & 0xFFFFFFFFu]);
+    }
+    std::size_t first = 0;
+    while (first < grouped.size()) {
+        std::size_t last = first + 1;
+        while (last < grouped.size() && grouped[last].ability == grouped[first].ability) {
+            ++last;
+        }
+        const auto* ability = static_cast<const ScriptedAbility*>(grouped[first].ability);
+        ability->activateBatch(grouped.data() + first, last - first, &kills);
+        first = last;
+    }
+    casts.clear();
+}
+
+namespace {
+// Recursive descent over one expression, emitting postfix instructions and
+// tracking how deep the stack gets
+class ScriptExpression {
+public:
+    ScriptExpression(const std::string& text, std::vector<ScriptedAbility::Instruction>& program)
+        : text(text), program(program) {}
+
+    // Empty on success, otherwise what went wrong
+    std::string compile() {
+        expression();
+        skipSpace();
+        if (problem.empty() && position != text.size()) {
+            problem = "unexpected '" + text.substr(position, 1) + "'";
+        }
+        if (problem.empty() && maxDepth > ScriptedAbility::maxStackDepth) {
+            problem = "expression nests too deeply";
+        }
+        return problem;
+    }
+
+private:
+    using Op = ScriptedAbility::Op;
+
+    const std::string& text;
+    std::vector<ScriptedAbility::Instruction>& program;
+    std::size_t position = 0;
+    std::size_t depth = 0;
+    std::size_t maxDepth = 0;
+    std::string problem;
+
+    // A binary operator right after a Push has a constant right-hand side
+    // (any longer operand would end in an operator): fold the two together
+    void emitBinary(Op op) {
+        if (!program.empty() && program.back().op == Op::Push &&
+            (op == Op::Add || op == Op::Subtract || op == Op::Multiply || op == Op::Divide)) {
+            ScriptedAbility::Instruction& constant = program.back();
+            if (op == Op::Subtract) {
+                constant.operand = -constant.operand; // Constants are non-negative, so this can't overflow
+            }
+            constant.op = op == Op::Multiply ? Op::MultiplyConstant
+                          : op == Op::Divide ? Op::DivideConstant
+                                             : Op::AddConstant;
+            --depth;
+            return;
+        }
+        emit(op, 0, -1);
+    }
+
+    void emit(Op op, std::int32_t operand, int stackChange) {
+        program.push_back(ScriptedAbility::Instruction{op, operand});
+        depth = static_cast<std::size_t>(static_cast<long>(depth) + stackChange);
+        maxDepth = std::max(maxDepth, depth);
+    }
+
+    void skipSpace() {
+        while (position < text.size() && (text[position] == ' ' || text[position] == '\t')) {
+            ++position;
+        }
+    }
+
+    bool accept(char c) {
+        skipSpace();
+        if (position < text.size() && text[position] == c) {
+            ++position;
+            return true;
+        }
+        return false;
+    }
+
+    void expect(char c) {
+        if (problem.empty() && !accept(c)) {
+            problem = std::string("expected '") + c + "'";
+        }
+    }
+
+    void expression() {
+        term();
+        while (problem.empty()) {
+            if (accept('+')) {
+                term();
+                emitBinary(Op::Add);
+            } else if (accept('-')) {
+                term();
+                emitBinary(Op::Subtract);
+            } else {
+                return;
+            }
+        }
+    }
+
+    void term() {
+        unary();
+        while (problem.empty()) {
+            if (accept('*')) {
+                unary();
+                emitBinary(Op::Multiply);
+            } else if (accept('/')) {
+                unary();
+                emitBinary(Op::Divide);
+            } else {
+                return;
+            }
+        }
+    }
+
+    void unary() {
+        if (accept('-')) {
+            unary();
+            emit(Op::Negate, 0, 0);
+        } else {
+            primary();
+        }
+    }
+
+    void primary() {
+        if (!problem.empty()) {
+            return;
+        }
+        if (accept('(')) {
+            expression();
+            expect(')');
+            return;
+        }
+        skipSpace();
+        std::size_t start = position;
+        if (position < text.size() && std::isdigit(static_cast<unsigned char>(text[position]))) {
+            long long value = 0;
+            while (position < text.size() && std::isdigit(static_cast<unsigned char>(text[position]))) {
+                value = value * 10 + (text[position++] - '0');
+                if (value > 0x7FFFFFFF) {
+                    problem = "number too large";
+                    return;
+                }
+            }
+            emit(Op::Push, static_cast<std::int32_t>(value), 1);
+            return;
+        }
+        while (position < text.size() &&
+               (std::isalnum(static_cast<unsigned char>(text[position])) || text[position] == '_')) {
+            ++position;
+        }
+        std::string word = text.substr(start, position - start);
+        if (word == "min" || word == "max") {
+            expect('(');
+            expression();
+            expect(',');
+            expression();
+            expect(')');
+            emit(word == "min" ? Op::Min : Op::Max, 0, -1);
+            return;
+        }
+        static const std::pair<const char*, ScriptedAbility::Variable> variables[] = {
+            {"level", ScriptedAbility::Variable::Level},
+            {"target_level", ScriptedAbility::Variable::TargetLevel},
+            {"bonus", ScriptedAbility::Variable::Bonus},
+            {"health", ScriptedAbility::Variable::Health},
+            {"max_health", ScriptedAbility::Variable::MaxHealth},
+            {"target_health", ScriptedAbility::Variable::TargetHealth},
+            {"target_max_health", ScriptedAbility::Variable::TargetMaxHealth},
+            {"mana", ScriptedAbility::Variable::Mana},
+        };
+        for (const auto& [variableName, variable] : variables) {
+            if (word == variableName) {
+                emit(Op::Load, static_cast<std::int32_t>(variable), 1);
+                return;
+            }
+        }
+        problem = word.empty() ? "expected a value" : "unknown name '" + word + "'";
+    }
+};
+
+std::string trimScript(const std::string& text) {
+    std::size_t begin = text.find_first_not_of(" \t\r");
+    if (begin == std::string::npos) {
+        return std::string();
+    }
+    std::size_t end = text.find_last_not_of(" \t\r");
+    return text.substr(begin, end - begin + 1);
+}
+
+bool parseScriptInt(const std::string& text, int& value) {
+    if (text.empty()) {
+        return false;
+    }
+    char* end = nullptr;
+    long parsed = std::strtol(text.c_str(), &end, 10);
+    if (*end != '\0' || parsed < 0 || parsed > 0x7FFFFFFF) {
+        return false;
+    }
+    value = static_cast<int>(parsed);
+    return true;
+}
+}
+
+bool loadAbilityScript(const std::string& source, AbilityRegistry& registry, std::string& error) {
+    std::vector<std::unique_ptr<ScriptedAbility>> abilities;
+    std::vector<std::unique_ptr<Ability>> newEffects; // Named by the scripts, not yet in the registry
+    std::size_t lineNumber = 0;
+    std::size_t start = 0;
+    auto fail = [&](const std::string& message) {
+        error = "line " + std::to_string(lineNumber) + ": " + message;
+        return false;
+    };
+    auto defined = [&](AbilityId id) {
+        if (registry.find(id)) {
+            return true;
+        }
+        for (const auto& ability : abilities) {
+            if (ability->id == id) {
+                return true;
+            }
+        }
+        for (const auto& effect : newEffects) {
+            if (effect->id == id) {
+                return true;
+            }
+        }
+        return false;
+    };
+
+    while (start <= source.size()) {
+        std::size_t end = source.find('\n', start);
+        if (end == std::string::npos) {
+            end = source.size();
+        }
+        std::string line = source.substr(start, end - start);
+        start = end + 1;
+        ++lineNumber;
+        line = trimScript(line.substr(0, line.find('#')));
+        if (line.empty()) {
+            continue;
+        }
+        std::size_t split = line.find_first_of(" \t");
+        std::string keyword = line.substr(0, split);
+        std::string rest = split == std::string::npos ? std::string() : trimScript(line.substr(split));
+
+        if (keyword == "ability") {
+            if (rest.empty()) {
+                return fail("ability needs a name");
+            }
+            if (defined(abilityIdOf(rest))) {
+                return fail("'" + rest + "' is already defined");
+            }
+            abilities.push_back(std::make_unique<ScriptedAbility>(rest));
+            continue;
+        }
+        if (abilities.empty()) {
+            return fail("'" + keyword + "' outside an ability");
+        }
+        ScriptedAbility& ability = *abilities.back();
+
+        if (keyword == "cost" || keyword == "cooldown") {
+            int value;
+            if (!parseScriptInt(rest, value)) {
+                return fail(keyword + " needs a non-negative integer");
+            }
+            (keyword == "cost" ? ability.resourceCost : ability.cooldown) = value;
+        } else if (keyword == "target") {
+            if (rest == "self") {
+                ability.targetType = TargetType::Self;
+            } else if (rest == "single") {
+                ability.targetType = TargetType::Single;
+            } else if (rest == "area") {
+                ability.targetType = TargetType::Area;
+            } else if (rest == "cone") {
+                ability.targetType = TargetType::Cone;
+            } else {
+                return fail("target is self, single, area or cone");
+            }
+        } else if (keyword == "damage" || keyword == "heal" || keyword == "restore") {
+            std::string problem = ScriptExpression(rest, ability.program).compile();
+            if (!problem.empty()) {
+                return fail(problem);
+            }
+            ScriptedAbility::Op op = keyword == "damage" ? ScriptedAbility::Op::Damage
+                                     : keyword == "heal" ? ScriptedAbility::Op::Heal
+                                                         : ScriptedAbility::Op::Restore;
+            ability.program.push_back(ScriptedAbility::Instruction{op, 0});
+            ability.dealsDamage = ability.dealsDamage || op == ScriptedAbility::Op::Damage;
+        } else if (keyword == "buff" || keyword == "debuff") {
+            std::size_t last = rest.find_last_of(" \t");
+            int duration;
+            if (last == std::string::npos || !parseScriptInt(rest.substr(last + 1), duration)) {
+                return fail(keyword + " needs a name and a duration");
+            }
+            std::string effectName = trimScript(rest.substr(0, last));
+            AbilityKind kind = keyword == "buff" ? AbilityKind::Buff : AbilityKind::Debuff;
+            AbilityId effectId = abilityIdOf(effectName);
+            const Ability* effect = registry.find(effectId);
+            for (const auto& pending : newEffects) {
+                if (pending->id == effectId) {
+                    effect = pending.get();
+                }
+            }
+            if (!effect) {
+                if (defined(effectId)) {
+                    return fail("'" + effectName + "' is an ability, not an effect");
+                }
+                if (kind == AbilityKind::Buff) {
+                    newEffects.push_back(std::make_unique<Buff>(effectName, duration));
+                } else {
+                    newEffects.push_back(std::make_unique<Debuff>(effectName, duration));
+                }
+                effect = newEffects.back().get();
+            } else if (effect->kind != kind) {
+                return fail("'" + effectName + "' is already defined as something else");
+            } else if ((kind == AbilityKind::Buff ? static_cast<const Buff*>(effect)->duration
+                                                  : static_cast<const Debuff*>(effect)->duration) != duration) {
+                return fail("'" + effectName + "' already has a different duration");
+            }
+            ability.effects.push_back(effect);
+            ability.program.push_back(ScriptedAbility::Instruction{
+                ScriptedAbility::Op::Effect, static_cast<std::int32_t>(ability.effects.size() - 1)});
+        } else {
+            return fail("unknown statement '" + keyword + "'");
+        }
+    }
+
+    for (auto& effect : newEffects) {
+        registry.add(std::move(effect));
+    }
+    for (auto& ability : abilities) {
+        registry.add(std::move(ability));
+    }
+    return true;
+}
+
+// --- Action Queue ---
+
+ActionQueue::ActionQueue(std::size_t capacity) {
+    std::size_t size = 2;
+    while (size < capacity) {
+        size *= 2;
+    }
+    cells = std::vector<Cell>(size);
+    mask = size - 1;
+    for (std::size_t i = 0; i < size; ++i) {
+        cells[i].sequence.store(i, std::memory_order_relaxed);
+    }
+}
+
+// A cell whose sequence equals the position is free for that position; the
+// producer claims the position, writes, then publishes position + 1
+bool ActionQueue::push(const ActionRecord& action) {
+    std::size_t position = enqueuePosition.load(std::memory_order_relaxed);
+    for (;;) {
+        Cell& cell = cells[position & mask];
+        std::size_t sequence = cell.sequence.load(std::memory_order_acquire);
+        std::ptrdiff_t lag = static_cast<std::ptrdiff_t>(sequence) - static_cast<std::ptrdiff_t>(position);
+        if (lag == 0) {
+            if (enqueuePosition.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+                cell.action = action;
+                cell.sequence.store(position + 1, std::memory_order_release);
+                return true;
+            }
+        } else if (lag < 0) {
+            return false; // The consumer hasn't freed this cell from the previous lap
+        } else {
+            position = enqueuePosition.load(std::memory_order_relaxed);
+        }
+    }
+}
+
+// Stops at the first cell not yet published, even if later ones are
+std::size_t ActionQueue::drain(ActionRecord* out, std::size_t maxCount) {
+    std::size_t count = 0;
+    while (count < maxCount) {
+        Cell& cell = cells[dequeuePosition & mask];
+        if (cell.sequence.load(std::memory_order_acquire) != dequeuePosition + 1) {
+            break;
+        }
+        out[count++] = cell.action;
+        cell.sequence.store(dequeuePosition + cells.size(), std::memory_order_release);
+        ++dequeuePosition;
+    }
+    return count;
+}
+
+void ActionBatch::bind(Character& character) {
+    std::uint32_t index = entityIndexOf(character.entity);
+    if (index >= byIndex.size()) {
+        byIndex.resize(index + 1, nullptr);
+    }
+    byIndex[index] = &character;
+}
+
+void ActionBatch::unbind(Character& character) {
+    std::uint32_t index = entityIndexOf(character.entity);
+    if (index < byIndex.size() && byIndex[index] == &character) {
+        byIndex[index] = nullptr;
+    }
+}
+
+// Stale ids (the entity was despawned and its index reused) don't match the
+// bound character's full id
+Character* ActionBatch::resolve(EntityId id) const {
+    std::uint32_t index = entityIndexOf(id);
+    if (id == invalidEntity || index >= byIndex.size()) {
+        return nullptr;
+    }
+    Character* character = byIndex[index];
+    return character && character->entity == id ? character : nullptr;
+}
+
+std::size_t ActionBatch::process(ActionQueue& queue, DamagePipeline& pipeline) {
+    drained.resize(maxBatch);
+    drained.resize(queue.drain(drained.data(), maxBatch));
+    // Every field is part of the key, so records that compare equal are
+    // identical and the order never depends on how producers interleaved
+    std::sort(drained.begin(), drained.end(), [](const ActionRecord& a, const ActionRecord& b) {
+        return std::tie(a.timestamp, a.caster, a.ability, a.target) <
+               std::tie(b.timestamp, b.caster, b.ability, b.target);
+    });
+
+    hits.clear();
+    std::size_t accepted = 0;
+    for (const ActionRecord& action : drained) {
+        Character* caster = resolve(action.caster);
+        Character* target = resolve(action.target);
+        if (!caster || !target) {
+            continue;
+        }
+        const Ability* ability = caster->beginAbility(action.ability);
+        if (caster->log) {
+            caster->log->recordAbility(*caster, action.ability, *target, ability != nullptr);
+        }
+        if (!ability) {
+            continue;
+        }
+        ++accepted;
+        if (ability->kind == AbilityKind::Melee || ability->kind == AbilityKind::Spell) {
+            hits.push_back(HitRecord{caster, target, ability});
+        } else if (ability->kind == AbilityKind::Scripted) {
+            scripted.add(HitRecord{caster, target, ability});
+        } else {
+            ability->activate(*caster, *target);
+        }
+    }
+    scripted.run();
+    pipeline.resolve(hits);
+    return accepted;
+}
+
+// --- Entity-Component Storage ---
+
+EntityId CombatWorld::spawn(HealthKind healthKind, int maxHp, ManaKind manaKind, int maxResource) {
+    std::uint32_t index;
+    if (!freeIndices.empty()) {
+        index = freeIndices.back();
+        freeIndices.pop_back();
+    } else {
+        index = static_cast<std::uint32_t>(slotOfIndex.size());
+        slotOfIndex.push_back(0);
+        generationOf.push_back(0);
+    }
+    EntityId id = (static_cast<EntityId>(generationOf[index]) << indexBits) | index;
+
+    slotOfIndex[index] = static_cast<std::uint32_t>(entities.size());
+    entities.push_back(id);
+    health.currentHealth.push_back(maxHp);
+    health.maxHealth.push_back(maxHp);
+    health.kind.push_back(healthKind);
+    // Rage starts empty, like RageEnergy
+    mana.currentMana.push_back(manaKind == ManaKind::Rage ? 0 : maxResource);
+    mana.maxMana.push_back(maxResource);
+    mana.kind.push_back(manaKind);
+    mana.combatTicks.push_back(0);
+    return id;
+}
+
+void CombatWorld::despawn(EntityId id) {
+    if (!isValid(id)) {
+        return;
+    }
+    std::size_t slot = slotOf(id);
+    std::size_t last = entities.size() - 1;
+    if (slot != last) {
+        // Swap-and-pop keeps the arrays dense
+        entities[slot] = entities[last];
+        health.currentHealth[slot] = health.currentHealth[last];
+        health.maxHealth[slot] = health.maxHealth[last];
+        health.kind[slot] = health.kind[last];
+        mana.currentMana[slot] = mana.currentMana[last];
+        mana.maxMana[slot] = mana.maxMana[last];
+        mana.kind[slot] = mana.kind[last];
+        mana.combatTicks[slot] = mana.combatTicks[last];
+        slotOfIndex[entities[slot] & indexMask] = static_cast<std::uint32_t>(slot);
+    }
+    entities.pop_back();
+    health.currentHealth.pop_back();
+    health.maxHealth.pop_back();
+    health.kind.pop_back();
+    mana.currentMana.pop_back();
+    mana.maxMana.pop_back();
+    mana.kind.pop_back();
+    mana.combatTicks.pop_back();
+
+    std::uint32_t index = id & indexMask;
+    ++generationOf[index]; // Invalidates outstanding ids for this index
+    freeIndices.push_back(index);
+}
+
+bool CombatWorld::isValid(EntityId id) const {
+    std::uint32_t index = id & indexMask;
+    return id != invalidEntity && index < generationOf.size() && generationOf[index] == (id >> indexBits);
+}
+
+std::size_t CombatWorld::slotOf(EntityId id) const {
+    return slotOfIndex[id & indexMask];
+}
+
+void CombatWorld::takeDamage(EntityId id, int amount) {
+    GAME_SPAN("CombatWorld::takeDamage");
+    if (!isValid(id)) {
+        return;
+    }
+    std::size_t slot = slotOf(id);
+    int dealt = health.kind[slot] == HealthKind::Armored ? ArmoredHealth::mitigate(amount) : amount;
+    GAME_COUNT("combat.damage_taken", dealt);
+    health.currentHealth[slot] = std::max(0, health.currentHealth[slot] - dealt);
+    enterCombat(slot);
+}
+
+void CombatWorld::heal(EntityId id, int amount) {
+    if (!isValid(id)) {
+        return;
+    }
+    std::size_t slot = slotOf(id);
+    health.currentHealth[slot] = std::min(health.maxHealth[slot], health.currentHealth[slot] + amount);
+}
+
+bool CombatWorld::isAlive(EntityId id) const {
+    return isValid(id) && health.currentHealth[slotOf(id)] > 0;
+}
+
+bool CombatWorld::consumeMana(EntityId id, int amount) {
+    if (!isValid(id)) {
+        return false;
+    }
+    std::size_t slot = slotOf(id);
+    enterCombat(slot);
+    if (mana.currentMana[slot] < amount) {
+        return false;
+    }
+    mana.currentMana[slot] -= amount;
+    return true;
+}
+
+void CombatWorld::regenerateMana(EntityId id, int amount) {
+    if (!isValid(id)) {
+        return;
+    }
+    std::size_t slot = slotOf(id);
+    mana.currentMana[slot] = std::max(0, std::min(mana.maxMana[slot], mana.currentMana[slot] + amount));
+}
+
+void CombatWorld::applyDamageOverTime(int amount) {
+    int armored = ArmoredHealth::mitigate(amount);
+    int* current = health.currentHealth.data();
+    const HealthKind* kind = health.kind.data();
+    for (std::size_t slot = 0, count = entities.size(); slot < count; ++slot) {
+        int dealt = kind[slot] == HealthKind::Armored ? armored : amount;
+        current[slot] = std::max(0, current[slot] - dealt);
+    }
+}
+
+void CombatWorld::regenerateAll(int amount) {
+    int* current = mana.currentMana.data();
+    const int* maximum = mana.maxMana.data();
+    std::size_t slot = 0;
+    std::size_t count = entities.size();
+#if defined(__AVX2__)
+    const __m256i delta = _mm256_set1_epi32(amount);
+    const __m256i zero = _mm256_setzero_si256();
+    for (; slot + 8 <= count; slot += 8) {
+        __m256i value = _mm256_add_epi32(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(current + slot)), delta);
+        value = _mm256_min_epi32(value, _mm256_loadu_si256(reinterpret_cast<const __m256i*>(maximum + slot)));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(current + slot), _mm256_max_epi32(value, zero));
+    }
+#elif defined(__ARM_NEON)
+    const int32x4_t delta = vdupq_n_s32(amount);
+    const int32x4_t zero = vdupq_n_s32(0);
+    for (; slot + 4 <= count; slot += 4) {
+        int32x4_t value = vminq_s32(vaddq_s32(vld1q_s32(current + slot), delta), vld1q_s32(maximum + slot));
+        vst1q_s32(current + slot, vmaxq_s32(value, zero));
+    }
+#endif
+    for (; slot < count; ++slot) {
+        current[slot] = std::max(0, std::min(maximum[slot], current[slot] + amount));
+    }
+}
+
+// Each entity's change is picked without branches: arcane rate for arcane
+// mana, otherwise the rage rate in combat or minus the decay out of it
+void CombatWorld::regenerate(const RegenerationRates& rates) {
+    GAME_SPAN("CombatWorld::regenerate");
+    static_assert(sizeof(ManaKind) == 1, "mana kinds are loaded as bytes");
+    int* current = mana.currentMana.data();
+    const int* maximum = mana.maxMana.data();
+    const std::uint8_t* kind = reinterpret_cast<const std::uint8_t*>(mana.kind.data());
+    std::uint8_t* combat = mana.combatTicks.data();
+    std::size_t slot = 0;
+    std::size_t count = entities.size();
+#if defined(__AVX2__)
+    const __m256i arcane = _mm256_set1_epi32(rates.arcanePerTick);
+    const __m256i rage = _mm256_set1_epi32(rates.ragePerTick);
+    const __m256i decay = _mm256_set1_epi32(-rates.rageDecayPerTick);
+    const __m256i arcaneKind = _mm256_set1_epi32(static_cast<int>(ManaKind::Arcane));
+    const __m256i zero = _mm256_setzero_si256();
+    for (; slot + 8 <= count; slot += 8) {
+        __m128i kinds = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(kind + slot));
+        __m128i ticks = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(combat + slot));
+        __m256i isArcane = _mm256_cmpeq_epi32(_mm256_cvtepu8_epi32(kinds), arcaneKind);
+        __m256i fighting = _mm256_cmpgt_epi32(_mm256_cvtepu8_epi32(ticks), zero);
+        __m256i delta = _mm256_blendv_epi8(_mm256_blendv_epi8(decay, rage, fighting), arcane, isArcane);
+        __m256i value = _mm256_add_epi32(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(current + slot)), delta);
+        value = _mm256_min_epi32(value, _mm256_loadu_si256(reinterpret_cast<const __m256i*>(maximum + slot)));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(current + slot), _mm256_max_epi32(value, zero));
+        _mm_storel_epi64(reinterpret_cast<__m128i*>(combat + slot), _mm_subs_epu8(ticks, _mm_set1_epi8(1)));
+    }
+#elif defined(__ARM_NEON)
+    const int32x4_t arcane = vdupq_n_s32(rates.arcanePerTick);
+    const int32x4_t rage = vdupq_n_s32(rates.ragePerTick);
+    const int32x4_t decay = vdupq_n_s32(-rates.rageDecayPerTick);
+    const int32x4_t zero = vdupq_n_s32(0);
+    for (; slot + 8 <= count; slot += 8) {
+        uint8x8_t kinds = vld1_u8(kind + slot);
+        uint8x8_t ticks = vld1_u8(combat + slot);
+        uint16x8_t isArcane = vmovl_u8(vceq_u8(kinds, vdup_n_u8(static_cast<std::uint8_t>(ManaKind::Arcane))));
+        uint16x8_t fighting = vmovl_u8(vcgt_u8(ticks, vdup_n_u8(0)));
+        for (int half = 0; half < 2; ++half) {
+            uint32x4_t arcaneMask = vmovl_u16(half ? vget_high_u16(isArcane) : vget_low_u16(isArcane));
+            uint32x4_t fightingMask = vmovl_u16(half ? vget_high_u16(fighting) : vget_low_u16(fighting));
+            arcaneMask = vtstq_u32(arcaneMask, arcaneMask); // Widen 0x00FF lanes to all ones
+            fightingMask = vtstq_u32(fightingMask, fightingMask);
+            int32x4_t delta = vbslq_s32(arcaneMask, arcane, vbslq_s32(fightingMask, rage, decay));
+            int* lane = current + slot + half * 4;
+            int32x4_t value = vminq_s32(vaddq_s32(vld1q_s32(lane), delta), vld1q_s32(maximum + slot + half * 4));
+            vst1q_s32(lane, vmaxq_s32(value, zero));
+        }
+        vst1_u8(combat + slot, vqsub_u8(ticks, vdup_n_u8(1)));
+    }
+#endif
+    // Masks rather than branches, like the vector loops: kinds and combat
+    // states are mixed unpredictably across slots. The timers get their own
+    // loop, so these byte stores don't sit between the mana loads.
+    const int arcaneDelta = rates.arcanePerTick;
+    const int rageDelta = rates.ragePerTick;
+    const int decayDelta = -rates.rageDecayPerTick;
+    std::size_t rest = slot;
+    for (; slot < count; ++slot) {
+        int isArcane = -static_cast<int>(kind[slot] == static_cast<std::uint8_t>(ManaKind::Arcane));
+        int fighting = -static_cast<int>(combat[slot] > 0);
+        int delta = (arcaneDelta & isArcane) | (((rageDelta & fighting) | (decayDelta & ~fighting)) & ~isArcane);
+        current[slot] = std::max(0, std::min(maximum[slot], current[slot] + delta));
+    }
+    for (slot = rest; slot < count; ++slot) {
+        combat[slot] = static_cast<std::uint8_t>(combat[slot] - (combat[slot] > 0));
+    }
+}
+
+// --- Character Pool ---
+
+CharacterPool::CharacterPool(CharacterArchetype archetype, std::size_t preallocate, std::size_t highWaterMark,
+                             CombatWorld* world)
+    : archetype(std::move(archetype)), highWaterMark(highWaterMark), world(world) {
+    std::size_t count = std::min(preallocate, highWaterMark);
+    pooled.reserve(highWaterMark);
+    for (std::size_t i = 0; i < count; ++i) {
+        pooled.push_back(create());
+    }
+}
+
+std::unique_ptr<Character> CharacterPool::create() {
+    auto character = std::make_unique<Character>(std::string(), 1);
+    character->name.reserve(32);
+    if (!world) {
+        if (archetype.healthKind == HealthKind::Armored) {
+            character->health = std::make_unique<ArmoredHealth>(archetype.maxHealth);
+        } else {
+            character->health = std::make_unique<StandardHealth>(archetype.maxHealth);
+        }
+        if (archetype.manaKind == ManaKind::Rage) {
+            character->mana = std::make_unique<RageEnergy>(archetype.maxResource);
+        } else {
+            character->mana = std::make_unique<ArcaneMana>(archetype.maxResource);
+        }
+    }
+    return character;
+}
+
+// Component values go back to what a fresh component would hold
+void CharacterPool::prepare(Character& character, const std::string& name, int level) {
+    character.reset(name, level);
+    if (world) {
+        character.world = world;
+        character.entity = world->spawn(archetype.healthKind, archetype.maxHealth, archetype.manaKind,
+                                        archetype.maxResource);
+    } else {
+        character.health->maxHealth = archetype.maxHealth;
+        character.health->currentHealth = archetype.maxHealth;
+        character.mana->maxMana = archetype.maxResource;
+        character.mana->currentMana = archetype.manaKind == ManaKind::Rage ? 0 : archetype.maxResource;
+    }
+    for (const Ability* ability : archetype.abilities) {
+        character.learnAbility(*ability);
+    }
+}
+
+std::unique_ptr<Character> CharacterPool::spawn(const std::string& name, int level) {
+    std::unique_ptr<Character> character;
+    if (!pooled.empty()) {
+        character = std::move(pooled.back());
+        pooled.pop_back();
+        ++stats.hits;
+    } else {
+        character = create();
+        ++stats.misses;
+    }
+    prepare(*character, name, level);
+    return character;
+}
+
+void CharacterPool::release(std::unique_ptr<Character> character) {
+    if (!character) {
+        return;
+    }
+    ++stats.released;
+    if (world && character->world == world) {
+        world->despawn(character->entity);
+        character->entity = invalidEntity;
+    }
+    if (pooled.size() >= highWaterMark) {
+        ++stats.discarded;
+        return; // Destroyed here
+    }
+    pooled.push_back(std::move(character));
+}
+
+void CharacterPool::setHighWaterMark(std::size_t mark) {
+    highWaterMark = mark;
+    if (pooled.size() > mark) {
+        pooled.resize(mark);
+    }
+}
+
+// --- Replication ---
+
+void BitWriter::write(std::uint32_t value, unsigned bits) {
+    if (bits < 32) {
+        value &= (1u << bits) - 1;
+    }
+    pending |= static_cast<std::uint64_t>(value) << pendingBits;
+    pendingBits += bits;
+    while (pendingBits >= 8) {
+        if (size < capacity) {
+            buffer[size++] = static_cast<std::uint8_t>(pending);
+        } else {
+            overflow = true;
+        }
+        pending >>= 8;
+        pendingBits -= 8;
+    }
+}
+
+void BitWriter::writeVarUint(std::uint32_t value) {
+    do {
+        std::uint32_t group = value & 0xFu;
+        value >>= 4;
+        write(group | (value ? 0x10u : 0u), 5);
+    } while (value);
+}
+
+void BitWriter::writeVarInt(std::int32_t value) {
+    std::uint32_t bits = static_cast<std::uint32_t>(value);
+    writeVarUint((bits << 1) ^ (value < 0 ? 0xFFFFFFFFu : 0u));
+}
+
+std::size_t BitWriter::finish() {
+    if (pendingBits > 0) {
+        write(0, 8 - pendingBits);
+    }
+    return overflow ? 0 : size;
+}
+
+std::uint32_t BitReader::read(unsigned bits) {
+    while (pendingBits < bits) {
+        if (offset < size) {
+            pending |= static_cast<std::uint64_t>(data[offset++]) << pendingBits;
+        } else {
+            overrun = true;
+        }
+        pendingBits += 8;
+    }
+    std::uint32_t value = static_cast<std::uint32_t>(pending & ((std::uint64_t{1} << bits) - 1));
+    pending >>= bits;
+    pendingBits -= bits;
+    return value;
+}
+
+std::uint32_t BitReader::readVarUint() {
+    std::uint32_t value = 0;
+    for (unsigned shift = 0; shift < 32; shift += 4) {
+        std::uint32_t group = read(5);
+        value |= (group & 0xFu) << shift;
+        if (!(group & 0x10u)) {
+            return value;
+        }
+    }
+    overrun = true; // More groups than a 32-bit value has
+    return value;
+}
+
+std::int32_t BitReader::readVarInt() {
+    std::uint32_t bits = readVarUint();
+    return static_cast<std::int32_t>((bits >> 1) ^ (0u - (bits & 1u)));
+}
+
+namespace {
+enum ReplicatedField : std::uint32_t {
+    replicatedHealth = 1u << 0,
+    replicatedMana = 1u << 1,
+    replicatedMaxima = 1u << 2,
+    replicatedCooldowns = 1u << 3,
+    replicatedEffects = 1u << 4,
+};
+constexpr unsigned replicatedFieldBits = 5;
+}
+
+ReplicationEncoder::ReplicationEncoder(std::size_t maxCharacters)
+    : maxCharacters(maxCharacters), baseline(maxCharacters), changedState(maxCharacters), changedIndex(maxCharacters) {}
+
+void ReplicationEncoder::capture(const Character& character, Replicated& state) {
+    state.currentHealth = state.maxHealth = state.currentMana = state.maxMana = 0;
+    if (character.world) {
+        // A despawned entity replicates as dead, with everything zeroed
+        if (character.world->isValid(character.entity)) {
+            std::size_t slot = character.world->slotOf(character.entity);
+            state.currentHealth = character.world->health.currentHealth[slot];
+            state.maxHealth = character.world->health.maxHealth[slot];
+            state.currentMana = character.world->mana.currentMana[slot];
+            state.maxMana = character.world->mana.maxMana[slot];
+        }
+    } else {
+        if (character.health) {
+            state.currentHealth = character.health->currentHealth;
+            state.maxHealth = character.health->maxHealth;
+        }
+        if (character.mana) {
+            state.currentMana = character.mana->currentMana;
+            state.maxMana = character.mana->maxMana;
+        }
+    }
+    const std::vector<AbilityId>& cooldowns = character.cooldowns();
+    state.cooldowns.count = static_cast<std::uint32_t>(std::min(cooldowns.size(), maxIdsPerList));
+    std::copy_n(cooldowns.begin(), state.cooldowns.count, state.cooldowns.ids);
+    state.effects.count = static_cast<std::uint32_t>(std::min(character.activeEffects.size(), maxIdsPerList));
+    for (std::uint32_t i = 0; i < state.effects.count; ++i) {
+        state.effects.ids[i] = character.activeEffects[i]->id;
+    }
+}
+
+namespace {
+template <typename List>
+bool sameIds(const List& a, const List& b) {
+    return a.count == b.count && std::equal(a.ids, a.ids + a.count, b.ids);
+}
+
+template <typename List>
+void writeIds(BitWriter& writer, const List& list) {
+    writer.writeVarUint(list.count);
+    for (std::uint32_t i = 0; i < list.count; ++i) {
+        writer.write(list.ids[i], 32);
+    }
+}
+
+// False on a list longer than any encoder writes
+bool readIds(BitReader& reader, std::vector<AbilityId>& ids) {
+    std::uint32_t count = reader.readVarUint();
+    ids.clear();
+    if (count > ReplicationEncoder::maxIdsPerList) {
+        return false;
+    }
+    for (std::uint32_t i = 0; i < count && !reader.exhausted(); ++i) {
+        ids.push_back(reader.read(32));
+    }
+    return true;
+}
+
+// Four one-group varints and two empty id lists
+constexpr std::size_t minSnapshotRecordBits = 6 * 5;
+}
+
+std::size_t ReplicationEncoder::encodeSnapshot(const std::vector<Character*>& characters, std::uint32_t tick,
+                                               std::uint8_t* buffer, std::size_t capacity) {
+    if (characters.size() > maxCharacters) {
+        return 0;
+    }
+    BitWriter writer(buffer, capacity);
+    writer.write(0, 1);
+    writer.write(tick, 32);
+    writer.writeVarUint(static_cast<std::uint32_t>(characters.size()));
+    // Captured straight into the baseline; if the snapshot doesn't fit,
+    // deltas are refused until one does
+    hasBaseline = false;
+    for (std::size_t i = 0; i < characters.size(); ++i) {
+        Replicated& state = baseline[i];
+        capture(*characters[i], state);
+        writer.writeVarUint(static_cast<std::uint32_t>(state.maxHealth));
+        writer.writeVarInt(state.currentHealth);
+        writer.writeVarUint(static_cast<std::uint32_t>(state.maxMana));
+        writer.writeVarInt(state.currentMana);
+        writeIds(writer, state.cooldowns);
+        writeIds(writer, state.effects);
+    }
+    std::size_t written = writer.finish();
+    if (written > 0) {
+        hasBaseline = true;
+        baselineCount = characters.size();
+    }
+    return written;
+}
+
+std::size_t ReplicationEncoder::encodeDelta(const std::vector<Character*>& characters, std::uint32_t tick,
+                                            std::uint8_t* buffer, std::size_t capacity) {
+    if (!hasBaseline || characters.size() != baselineCount) {
+        return 0;
+    }
+    // Compare everything, encode only what differs; the baseline moves only
+    // once the whole message fits
+    std::size_t changedCount = 0;
+    for (std::size_t i = 0; i < characters.size(); ++i) {
+        Replicated& state = changedState[changedCount];
+        capture(*characters[i], state);
+        const Replicated& previous = baseline[i];
+        if (state.currentHealth != previous.currentHealth || state.currentMana != previous.currentMana ||
+            state.maxHealth != previous.maxHealth || state.maxMana != previous.maxMana ||
+            !sameIds(state.cooldowns, previous.cooldowns) || !sameIds(state.effects, previous.effects)) {
+            changedIndex[changedCount++] = static_cast<std::uint32_t>(i);
+        }
+    }
+
+    BitWriter writer(buffer, capacity);
+    writer.write(1, 1);
+    writer.write(tick, 32);
+    writer.writeVarUint(static_cast<std::uint32_t>(changedCount));
+    std::uint32_t next = 0; // First index the next gap counts from
+    for (std::size_t k = 0; k < changedCount && !writer.overflowed(); ++k) {
+        const Replicated& state = changedState[k];
+        const Replicated& previous = baseline[changedIndex[k]];
+        std::uint32_t fields = 0;
+        fields |= state.currentHealth != previous.currentHealth ? replicatedHealth : 0u;
+        fields |= state.currentMana != previous.currentMana ? replicatedMana : 0u;
+        fields |= state.maxHealth != previous.maxHealth || state.maxMana != previous.maxMana ? replicatedMaxima : 0u;
+        fields |= sameIds(state.cooldowns, previous.cooldowns) ? 0u : replicatedCooldowns;
+        fields |= sameIds(state.effects, previous.effects) ? 0u : replicatedEffects;
+
+        writer.writeVarUint(changedIndex[k] - next);
+        next = changedIndex[k] + 1;
+        writer.write(fields, replicatedFieldBits);
+        if (fields & replicatedHealth) {
+            writer.writeVarInt(state.currentHealth - previous.currentHealth);
+        }
+        if (fields & replicatedMana) {
+            writer.writeVarInt(state.currentMana - previous.currentMana);
+        }
+        if (fields & replicatedMaxima) {
+            writer.writeVarUint(static_cast<std::uint32_t>(state.maxHealth));
+            writer.writeVarUint(static_cast<std::uint32_t>(state.maxMana));
+        }
+        if (fields & replicatedCooldowns) {
+            writeIds(writer, state.cooldowns);
+        }
+        if (fields & replicatedEffects) {
+            writeIds(writer, state.effects);
+        }
+    }
+    std::size_t written = writer.finish();
+    if (written > 0) {
+        for (std::size_t k = 0; k < changedCount; ++k) {
+            baseline[changedIndex[k]] = changedState[k];
+        }
+    }
+    return written;
+}
+
+bool ReplicationDecoder::apply(const std::uint8_t* data, std::size_t size) {
+    BitReader reader(data, size);
+    bool delta = reader.read(1) != 0;
+    std::uint32_t tick = reader.read(32);
+    std::uint32_t count = reader.readVarUint();
+    if (reader.exhausted() || (delta && !hasSnapshot)) {
+        return false;
+    }
+
+    if (!delta) {
+        hasSnapshot = false;
+        // The count is untrusted: refuse one the message is too short to hold
+        // before allocating for it
+        if (count > reader.remainingBits() / minSnapshotRecordBits) {
+            return false;
+        }
+        replicas.resize(count);
+        for (State& state : replicas) {
+            state.maxHealth = static_cast<int>(reader.readVarUint());
+            state.currentHealth = reader.readVarInt();
+            state.maxMana = static_cast<int>(reader.readVarUint());
+            state.currentMana = reader.readVarInt();
+            if (!readIds(reader, state.cooldowns) || !readIds(reader, state.effects) || reader.exhausted()) {
+                return false;
+            }
+        }
+        hasSnapshot = true;
+    } else {
+        std::uint32_t next = 0;
+        for (std::uint32_t k = 0; k < count; ++k) {
+            std::uint32_t index = next + reader.readVarUint();
+            std::uint32_t fields = reader.read(replicatedFieldBits);
+            if (reader.exhausted() || index >= replicas.size()) {
+                return false;
+            }
+            next = index + 1;
+            State& state = replicas[index];
+            if (fields & replicatedHealth) {
+                state.currentHealth += reader.readVarInt();
+            }
+            if (fields & replicatedMana) {
+                state.currentMana += reader.readVarInt();
+            }
+            if (fields & replicatedMaxima) {
+                state.maxHealth = static_cast<int>(reader.readVarUint());
+                state.maxMana = static_cast<int>(reader.readVarUint());
+            }
+            if ((fields & replicatedCooldowns) && !readIds(reader, state.cooldowns)) {
+                return false;
+            }
+            if ((fields & replicatedEffects) && !readIds(reader, state.effects)) {
+                return false;
+            }
+            if (reader.exhausted()) {
+                return false;
+            }
+        }
+    }
+    lastTick = tick;
+    return true;
+}
+
+// --- Combat Log ---
+
+// Single-producer ring: the owning thread advances head, the writer tail
+struct CombatLog::Ring {
+    std::vector<CombatEvent> slots;
+    std::size_t mask;
+    std::thread::id owner;
+    std::uint8_t index;
+    alignas(64) std::atomic<std::uint64_t> head{0};
+    std::atomic<std::uint64_t> dropped{0}; // Owner writes, stats() reads
+    alignas(64) std::atomic<std::uint64_t> tail{0};
+};
+
+namespace {
+std::atomic<std::uint64_t> nextLogSerial{1};
+
+constexpr std::uint32_t logFileMagic = 0x474F4C43u; // "CLOG"
+constexpr std::uint32_t logFileVersion = 1;
+
+void appendVarUint(std::vector<std::uint8_t>& out, std::uint32_t value) {
+    while (value >= 0x80u) {
+        out.push_back(static_cast<std::uint8_t>(value | 0x80u));
+        value >>= 7;
+    }
+    out.push_back(static_cast<std::uint8_t>(value));
+}
+
+void appendVarInt(std::vector<std::uint8_t>& out, std::int64_t value) {
+    // Differences of 32-bit fields need 33 bits; wrap them back into 32
+    std::uint32_t bits = static_cast<std::uint32_t>(value);
+    appendVarUint(out, (bits << 1) ^ (static_cast<std::int32_t>(bits) < 0 ? 0xFFFFFFFFu : 0u));
+}
+
+void appendU32(std::vector<std::uint8_t>& out, std::uint32_t value) {
+    for (int shift = 0; shift < 32; shift += 8) {
+        out.push_back(static_cast<std::uint8_t>(value >> shift));
+    }
+}
+
+// (value, run length) pairs
+template <typename Field>
+void appendRuns(std::vector<std::uint8_t>& out, const std::vector<CombatEvent>& events, Field field) {
+    std::size_t i = 0;
+    while (i < events.size()) {
+        std::uint8_t value = field(events[i]);
+        std::size_t run = 1;
+        while (i + run < events.size() && field(events[i + run]) == value) {
+            ++run;
+        }
+        out.push_back(value);
+        appendVarUint(out, static_cast<std::uint32_t>(run));
+        i += run;
+    }
+}
+
+// Reads one column or block field, flagging anything past the end
+struct LogCursor {
+    const std::uint8_t* data;
+    std::size_t size;
+    std::size_t offset = 0;
+    bool bad = false;
+
+    std::uint8_t byte() {
+        if (offset >= size) {
+            bad = true;
+            return 0;
+        }
+        return data[offset++];
+    }
+    std::uint32_t u32() {
+        std::uint32_t value = 0;
+        for (int shift = 0; shift < 32; shift += 8) {
+            value |= static_cast<std::uint32_t>(byte()) << shift;
+        }
+        return value;
+    }
+    std::uint32_t varUint() {
+        std::uint32_t value = 0;
+        for (int shift = 0; shift < 35; shift += 7) {
+            std::uint8_t next = byte();
+            value |= static_cast<std::uint32_t>(next & 0x7Fu) << shift;
+            if (!(next & 0x80u)) {
+                return value;
+            }
+        }
+        bad = true;
+        return value;
+    }
+    std::int32_t varInt() {
+        std::uint32_t bits = varUint();
+        return static_cast<std::int32_t>((bits >> 1) ^ (0u - (bits & 1u)));
+    }
+};
+}
+
+CombatLog::Options CombatLog::defaultOptions(const std::string& path) {
+    return Options{path, std::size_t{1} << 16, std::size_t{1} << 12, std::size_t{64} << 20, std::chrono::milliseconds(5)};
+}
+
+CombatLog::CombatLog(Options options)
+    : options(std::move(options)), serial(nextLogSerial.fetch_add(1, std::memory_order_relaxed)) {
+    this->options.blockEvents = std::max<std::size_t>(1, this->options.blockEvents);
+    block.reserve(this->options.blockEvents);
+    writer = std::thread([this] { writerLoop(); });
+}
+
+CombatLog::~CombatLog() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    wake.notify_one();
+    writer.join();
+    if (file) {
+        std::fclose(file);
+    }
+}
+
+// The first event from a thread registers its ring; later ones find it in
+// a thread-local cache
+CombatLog::Ring& CombatLog::localRing() {
+    thread_local std::uint64_t cachedSerial = 0;
+    thread_local Ring* cachedRing = nullptr;
+    if (cachedSerial == serial) {
+        return *cachedRing;
+    }
+    std::thread::id self = std::this_thread::get_id();
+    std::lock_guard<std::mutex> lock(mutex);
+    Ring* ring = nullptr;
+    for (const auto& candidate : rings) {
+        if (candidate->owner == self) {
+            ring = candidate.get();
+        }
+    }
+    if (!ring) {
+        auto created = std::make_unique<Ring>();
+        std::size_t capacity = 2;
+        while (capacity < options.ringCapacity) {
+            capacity *= 2;
+        }
+        created->slots.resize(capacity);
+        created->mask = capacity - 1;
+        created->owner = self;
+        created->index = static_cast<std::uint8_t>(std::min<std::size_t>(rings.size(), 255));
+        ring = created.get();
+        rings.push_back(std::move(created));
+    }
+    cachedSerial = serial;
+    cachedRing = ring;
+    return *ring;
+}
+
+void CombatLog::record(CombatEvent event) {
+    Ring& ring = localRing();
+    std::uint64_t head = ring.head.load(std::memory_order_relaxed);
+    if (head - ring.tail.load(std::memory_order_acquire) > ring.mask) {
+        ring.dropped.store(ring.dropped.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        return;
+    }
+    event.tick = currentTick.load(std::memory_order_relaxed);
+    event.thread = ring.index;
+    ring.slots[head & ring.mask] = event;
+    ring.head.store(head + 1, std::memory_order_release);
+}
+
+void CombatLog::recordAbility(const Character& caster, AbilityId ability, const Character& target, bool used) {
+    record(CombatEvent{0, caster.logId, target.logId, ability, 0, used ? 1 : 0, CombatEvent::Kind::UseAbility, 0});
+}
+
+void CombatLog::flush() {
+    std::unique_lock<std::mutex> lock(mutex);
+    std::uint64_t ticket = ++flushRequested;
+    wake.notify_one();
+    flushed.wait(lock, [&] { return flushCompleted >= ticket; });
+}
+
+CombatLog::Stats CombatLog::stats() const {
+    Stats result{};
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (const auto& ring : rings) {
+            result.recorded += ring->head.load(std::memory_order_acquire);
+            result.dropped += ring->dropped.load(std::memory_order_relaxed);
+        }
+    }
+    result.written = written.load(std::memory_order_relaxed);
+    result.blocks = blocks.load(std::memory_order_relaxed);
+    result.files = files.load(std::memory_order_relaxed);
+    result.bytes = bytes.load(std::memory_order_relaxed);
+    result.failedWrites = failedWrites.load(std::memory_order_relaxed);
+    return result;
+}
+
+void CombatLog::writerLoop() {
+    std::vector<Ring*> current;
+    bool behind = false;
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true) {
+        if (!behind) {
+            wake.wait_for(lock, options.flushInterval, [&] { return stopping || flushRequested > flushCompleted; });
+        }
+        bool stop = stopping;
+        std::uint64_t ticket = flushRequested;
+        current.clear();
+        for (const auto& ring : rings) {
+            current.push_back(ring.get());
+        }
+        lock.unlock();
+
+        behind = false;
+        for (Ring* ring : current) {
+            behind = drain(*ring) || behind;
+        }
+        if (!block.empty() && (stop || ticket > flushCompleted)) {
+            writeBlock();
+        }
+        if (file && ticket > flushCompleted) {
+            std::fflush(file);
+        }
+
+        lock.lock();
+        flushCompleted = ticket;
+        flushed.notify_all();
+        if (stop) {
+            return;
+        }
+    }
+}
+
+bool CombatLog::drain(Ring& ring) {
+    std::uint64_t tail = ring.tail.load(std::memory_order_relaxed);
+    std::uint64_t head = ring.head.load(std::memory_order_acquire);
+    bool behind = head - tail > ring.mask / 2;
+    while (tail != head) {
+        block.push_back(ring.slots[tail & ring.mask]);
+        ++tail;
+        if (block.size() == options.blockEvents) {
+            ring.tail.store(tail, std::memory_order_release);
+            writeBlock();
+        }
+    }
+    ring.tail.store(tail, std::memory_order_release);
+    return behind;
+}
+
+// Block: event count, dictionary size, dictionary ids, then each column as
+// byte length + bytes:
+//   tick, actor       zigzag varint of the difference to the previous event
+//   target            zigzag varint of target - actor (0 for self events)
+//   ability           varuint dictionary index
+//   amount, result    zigzag varint
+//   kind, thread      runs of (value byte, varuint length)
+void CombatLog::writeBlock() {
+    dictionary.clear();
+    for (const CombatEvent& event : block) {
+        dictionary.push_back(event.ability);
+    }
+    std::sort(dictionary.begin(), dictionary.end());
+    dictionary.erase(std::unique(dictionary.begin(), dictionary.end()), dictionary.end());
+
+    for (auto& column : columns) {
+        column.clear();
+    }
+    std::uint32_t previousTick = 0;
+    std::uint32_t previousActor = 0;
+    for (const CombatEvent& event : block) {
+        appendVarInt(columns[0], std::int64_t{event.tick} - previousTick);
+        appendVarInt(columns[1], std::int64_t{event.actor} - previousActor);
+        appendVarInt(columns[2], std::int64_t{event.target} - event.actor);
+        appendVarUint(columns[3], static_cast<std::uint32_t>(
+                                      std::lower_bound(dictionary.begin(), dictionary.end(), event.ability) -
+                                      dictionary.begin()));
+        appendVarInt(columns[4], event.amount);
+        appendVarInt(columns[5], event.result);
+        previousTick = event.tick;
+        previousActor = event.actor;
+    }
+    appendRuns(columns[6], block, [](const CombatEvent& event) { return static_cast<std::uint8_t>(event.kind); });
+    appendRuns(columns[7], block, [](const CombatEvent& event) { return event.thread; });
+
+    std::vector<std::uint8_t>& out = blockBytes;
+    out.clear();
+    appendU32(out, static_cast<std::uint32_t>(block.size()));
+    appendU32(out, static_cast<std::uint32_t>(dictionary.size()));
+    for (AbilityId id : dictionary) {
+        appendU32(out, id);
+    }
+    for (const auto& column : columns) {
+        appendU32(out, static_cast<std::uint32_t>(column.size()));
+        out.insert(out.end(), column.begin(), column.end());
+    }
+
+    if (!file) {
+        std::string name = options.path + "." + std::to_string(fileIndex);
+        file = std::fopen(name.c_str(), "wb");
+        if (!file) {
+            failedWrites.fetch_add(1, std::memory_order_relaxed);
+            block.clear();
+            return;
+        }
+        std::uint8_t header[8];
+        for (int shift = 0; shift < 32; shift += 8) {
+            header[shift / 8] = static_cast<std::uint8_t>(logFileMagic >> shift);
+            header[4 + shift / 8] = static_cast<std::uint8_t>(logFileVersion >> shift);
+        }
+        std::fwrite(header, 1, sizeof(header), file);
+        fileBytes = sizeof(header);
+        files.fetch_add(1, std::memory_order_relaxed);
+    }
+    if (std::fwrite(out.data(), 1, out.size(), file) != out.size()) {
+        failedWrites.fetch_add(1, std::memory_order_relaxed);
+    } else {
+        written.fetch_add(block.size(), std::memory_order_relaxed);
+        blocks.fetch_add(1, std::memory_order_relaxed);
+        bytes.fetch_add(out.size(), std::memory_order_relaxed);
+    }
+    fileBytes += out.size();
+    block.clear();
+    if (fileBytes >= options.rotateBytes) {
+        std::fclose(file);
+        file = nullptr;
+        ++fileIndex;
+    }
+}
+
+bool CombatLog::readFile(const std::string& path, std::vector<CombatEvent>& events) {
+    std::FILE* in = std::fopen(path.c_str(), "rb");
+    if (!in) {
+        return false;
+    }
+    std::vector<std::uint8_t> data;
+    std::uint8_t chunk[1 << 16];
+    std::size_t got;
+    while ((got = std::fread(chunk, 1, sizeof(chunk), in)) > 0) {
+        data.insert(data.end(), chunk, chunk + got);
+    }
+    std::fclose(in);
+
+    LogCursor file{data.data(), data.size()};
+    if (file.u32() != logFileMagic || file.u32() != logFileVersion || file.bad) {
+        return false;
+    }
+    while (file.offset < file.size) {
+        std::uint32_t count = file.u32();
+        std::uint32_t dictionarySize = file.u32();
+        if (file.bad || dictionarySize > (file.size - file.offset) / 4) {
+            return false;
+        }
+        std::vector<AbilityId> dictionary(dictionarySize);
+        for (AbilityId& id : dictionary) {
+            id = file.u32();
+        }
+        LogCursor columns[columnCount] = {};
+        for (LogCursor& column : columns) {
+            std::uint32_t length = file.u32();
+            if (file.bad || length > file.size - file.offset) {
+                return false;
+            }
+            column.data = file.data + file.offset;
+            column.size = length;
+            file.offset += length;
+        }
+        // Every event takes at least one byte of each varint column, so a
+        // forged count can't make the loop outrun the file
+        if (count > columns[0].size) {
+            return false;
+        }
+
+        std::size_t first = events.size();
+        std::uint32_t tick = 0;
+        std::uint32_t actor = 0;
+        for (std::uint32_t i = 0; i < count; ++i) {
+            CombatEvent event{};
+            tick += static_cast<std::uint32_t>(columns[0].varInt());
+            actor += static_cast<std::uint32_t>(columns[1].varInt());
+            event.tick = tick;
+            event.actor = actor;
+            event.target = actor + static_cast<std::uint32_t>(columns[2].varInt());
+            std::uint32_t index = columns[3].varUint();
+            event.ability = index < dictionary.size() ? dictionary[index] : 0;
+            event.amount = columns[4].varInt();
+            event.result = columns[5].varInt();
+            if (index >= dictionary.size()) {
+                return false;
+            }
+            events.push_back(event);
+        }
+        for (int c = 0; c < 6; ++c) {
+            if (columns[c].bad) {
+                return false;
+            }
+        }
+        for (int c = 6; c < 8; ++c) {
+            std::size_t i = first;
+            while (i < events.size()) {
+                std::uint8_t value = columns[c].byte();
+                std::uint32_t run = columns[c].varUint();
+                if (columns[c].bad || run == 0 || run > events.size() - i) {
+                    return false;
+                }
+                for (std::uint32_t k = 0; k < run; ++k, ++i) {
+                    if (c == 6) {
+                        events[i].kind = static_cast<CombatEvent::Kind>(value);
+                    } else {
+                        events[i].thread = value;
+                    }
+                }
+            }
+        }
+    }
+    return true;
+}
+
+// --- Loot ---
+
+LootPipeline::LootPipeline(std::uint64_t seed) : rngState(seed) {}
+
+void LootPipeline::recordKill(Character& killer, const LootTable& table) {
+    kills.push_back(Kill{&killer, &table});
+}
+
+void LootPipeline::recordKills(const std::vector<HitRecord>& killingHits, const LootTable& table) {
+    for (const HitRecord& hit : killingHits) {
+        kills.push_back(Kill{hit.caster, &table});
+    }
+}
+
+// splitmix64, cheap and good enough for loot
+std::uint32_t LootPipeline::nextRandom() {
+    std::uint64_t z = (rngState += 0x9E3779B97F4A7C15ull);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+    return static_cast<std::uint32_t>((z ^ (z >> 31)) >> 32);
+}
+
+// Rolls every kill in order, then groups the drops by recipient with two
+// sorts: kills by killer, to find each killer's first kill, and drops by
+// (first kill, roll index)
+void LootPipeline::roll() {
+    byKiller.clear();
+    for (std::size_t k = 0; k < kills.size(); ++k) {
+        byKiller.emplace_back(kills[k].killer, static_cast<std::uint32_t>(k));
+    }
+    std::sort(byKiller.begin(), byKiller.end());
+    firstKill.resize(kills.size());
+    for (std::size_t i = 0; i < byKiller.size(); ++i) {
+        bool sameKiller = i > 0 && byKiller[i].first == byKiller[i - 1].first;
+        firstKill[byKiller[i].second] = sameKiller ? firstKill[byKiller[i - 1].second] : byKiller[i].second;
+    }
+
+    keys.clear();
+    rolled.clear();
+    for (std::size_t k = 0; k < kills.size(); ++k) {
+        for (const LootEntry& entry : kills[k].table->entries) {
+            if (nextRandom() % 1000 >= entry.chancePerMille) {
+                continue;
+            }
+            int spread = std::max(0, entry.maxQuantity - entry.minQuantity);
+            int quantity = entry.minQuantity + static_cast<int>(nextRandom() % static_cast<std::uint32_t>(spread + 1));
+            if (quantity > 0) {
+                keys.push_back(static_cast<std::uint64_t>(firstKill[k]) << 32 | rolled.size());
+                rolled.push_back(LootDrop{&entry, quantity});
+            }
+        }
+    }
+    std::sort(keys.begin(), keys.end());
+
+    grouped.clear();
+    recipients.clear();
+    groupStart.clear();
+    for (std::size_t i = 0; i < keys.size(); ++i) {
+        std::uint32_t kill = static_cast<std::uint32_t>(keys[i] >> 32);
+        if (i == 0 || kill != keys[i - 1] >> 32) {
+            recipients.push_back(kills[kill].killer);
+            groupStart.push_back(i);
+        }
+        grouped.push_back(rolled[keys[i] & 0xFFFFFFFFu]);
+    }
+    groupStart.push_back(grouped.size());
+    kills.clear();
+}
@@ -1,172 +1,1327 @@
-// game_combat_system.h
-#ifndef GAME_COMBAT_SYSTEM_H
-#define GAME_COMBAT_SYSTEM_H
-
-#include <string>
-#include <vector>
-#include <memory> // For std::unique_ptr or std::shared_ptr if we want ownership
-
-// Forward declarations to avoid circular dependencies for pointers/references
-class HealthComponent;
-class ManaComponent;
-class Ability;
-class DamageCalculator;
-class TargetSelection;
-
-// --- Character Class ---
-class Character {
-public:
-    std::string name;
-    int level;
-    
-    // Using smart pointers for components for ownership and lifetime management
-    std::unique_ptr<HealthComponent> health;
-    std::unique_ptr<ManaComponent> mana;
-    
-    std::vector<std::unique_ptr<Ability>> abilities; // Character owns its abilities
-
-    Character(const std::string& name, int level);
-    ~Character(); // Destructor to properly clean up unique_ptrs if needed
-
-    void attack(Character& target);
-    void useAbility(const std::string& abilityName, Character& target); // Using string for simplicity to find ability
-    // Or, more robust: void useAbility(Ability& ability, Character& target);
-    
-private:
-    // Helper to find ability by name, could be made public or part of AbilityManager
-    Ability* findAbility(const std::string& abilityName);
-};
-
-// --- Health Components ---
-
-class HealthComponent {
-public:
-    virtual ~HealthComponent() = default; // Virtual destructor for proper polymorphic cleanup
-
-    int currentHealth;
-    int maxHealth;
-
-    // Pure virtual functions, must be implemented by subclasses
-    virtual void takeDamage(int amount) = 0;
-    virtual void heal(int amount);
-    virtual bool isAlive() const;
-
-protected:
-    HealthComponent(int maxHp);
-};
-
-class StandardHealth : public HealthComponent {
-public:
-    StandardHealth(int maxHp);
-    void takeDamage(int amount) override;
-};
-
-class ArmoredHealth : public HealthComponent {
-public:
-    ArmoredHealth(int maxHp);
-    void takeDamage(int amount) override; // May apply damage reduction
-};
-
-// --- Mana/Resource Components ---
-
-class ManaComponent {
-public:
-    virtual ~ManaComponent() = default; // Virtual destructor
-
-    int currentMana;
-    int maxMana;
-
-    // Pure virtual functions
-    virtual bool consumeMana(int amount) = 0;
-    virtual void regenerateMana(int amount) = 0;
-
-protected:
-    ManaComponent(int maxResource);
-};
-
-class ArcaneMana : public ManaComponent {
-public:
-    ArcaneMana(int maxResource);
-    bool consumeMana(int amount) override;
-    void regenerateMana(int amount) override;
-};
-
-class RageEnergy : public ManaComponent {
-public:
-    RageEnergy(int maxResource);
-    bool consumeMana(int amount) override; // Renamed for clarity in diagram, but still consumeMana here
-    void regenerateMana(int amount) override; // Might be triggered by combat
-};
-
-// --- Ability Classes ---
-
-class Ability {
-public:
-    virtual ~Ability() = default; // Virtual destructor
-
-    std::string name;
-    int resourceCost;
-    int cooldown; // Not directly used in methods here, but good to include
-
-    // Pure virtual function
-    virtual void activate(Character& caster, Character& target) = 0;
-
-protected:
-    // Pointers to collaborators, assuming they are managed externally or passed by ref
-    DamageCalculator* damageCalculator;
-    TargetSelection* targetSelection;
-
-    Ability(const std::string& name, int cost, DamageCalculator* dc, TargetSelection* ts);
-};
-
-class MeleeAttack : public Ability {
-public:
-    int baseDamage;
-    MeleeAttack(int baseDmg, DamageCalculator* dc, TargetSelection* ts);
-    void activate(Character& caster, Character& target) override;
-};
-
-class SpellCast : public Ability {
-public:
-    std::string spellEffect; // Could be an enum or a more complex effect object
-    SpellCast(const std::string& effect, DamageCalculator* dc, TargetSelection* ts);
-    void activate(Character& caster, Character& target) override;
-};
-
-class Buff : public Ability {
-public:
-    std::string effectDescription;
-    int duration;
-    Buff(const std::string& description, int dur);
-    void activate(Character& caster, Character& target) override;
-    void apply(Character& target); // Helper to apply the actual effect
-    void remove(Character& target); // Helper to remove the effect
-};
-
-class Debuff : public Ability {
-public:
-    std::string effectDescription;
-    int duration;
-    Debuff(const std::string& description, int dur);
-    void activate(Character& caster, Character& target) override;
-    void apply(Character& target); // Helper to apply the actual effect
-    void remove(Character& target); // Helper to remove the effect
-};
-
-// --- Utility Classes ---
-
-class DamageCalculator {
-public:
-    int calculateDamage(const Ability& ability, const Character& caster, const Character& target);
-    // Might have more complex parameters like armor, resistances, etc.
-};
-
-class TargetSelection {
-public:
-    // Returns a vector of pointers/references to characters that are valid targets
-    std::vector<Character*> selectTargets(Character& caster, const Ability& ability);
-    // Overload for specific targeting types (e.g., single, area, self)
-    std::vector<Character*> selectTargets(Character& caster, const Ability& ability, const std::string& targetType);
-};
-
+// game_combat_system.h
+#ifndef GAME_COMBAT_SYSTEM_H
+#define GAME_COMBAT_SYSTEM_H
+
+#include <string>
+#include <vector>
+#include <memory> // For std::unique_ptr or std::shared_ptr if we want ownership
+#include <cstdint> // For fixed-width entity ids and component tags
+#include <cstddef> // For std::size_t
+#include <unordered_map> // For SpatialGrid cells
+#include <string_view> // For compile-time ability ids
+#include <utility> // For std::pair
+#include <functional> // For WorkStealingPool tasks
+#include <deque> // For per-worker task queues
+#include <thread> // For WorkStealingPool workers
+#include <mutex> // For WorkStealingPool queues
+#include <condition_variable> // For waking workers and waiting on them
+#include <atomic> // For the lock-free ActionQueue
+#include <variant> // For runtime-chosen health/mana policies
+#include <algorithm> // For std::min, std::max in the inline policies
+#include <chrono> // For the CombatLog flush interval
+#include <cstdio> // For CombatLog files
+
+// Forward declarations to avoid circular dependencies for pointers/references
+class HealthComponent;
+class ManaComponent;
+class Ability;
+class DamageCalculator;
+class TargetSelection;
+class CombatWorld;
+class SpatialGrid;
+class CombatTimers;
+class EncounterScheduler;
+class DamagePipeline;
+class CombatLog;
+
+// Location or direction on the encounter's 2D plane
+struct Position {
+    float x;
+    float y;
+};
+
+// Numeric ability id: the FNV-1a hash of the ability's name, so ids for known
+// abilities are compile-time constants and the string API can map onto them.
+// Ability names on one character must not share an id.
+using AbilityId = std::uint32_t;
+
+constexpr AbilityId abilityIdOf(std::string_view name) {
+    std::uint32_t hash = 2166136261u;
+    for (char c : name) {
+        hash = (hash ^ static_cast<unsigned char>(c)) * 16777619u;
+    }
+    return hash;
+}
+
+constexpr AbilityId meleeAttackId = abilityIdOf("Melee Attack");
+
+enum class TargetType : std::uint8_t { Self, Single, Area, Cone };
+
+// Maps "self", "single", "area" and "cone"; anything else is Single
+TargetType parseTargetType(const std::string& targetType);
+
+// Concrete ability type, so hot paths can branch on an integer instead of dynamic_cast
+enum class AbilityKind : std::uint8_t { Melee, Spell, Buff, Debuff, Scripted };
+
+// Handle to an entity in a CombatWorld: low 24 bits index, high 8 bits generation
+using EntityId = std::uint32_t;
+constexpr EntityId invalidEntity = 0xFFFFFFFFu;
+
+constexpr std::uint32_t entityIndexOf(EntityId id) { return id & 0xFFFFFFu; }
+
+// --- Character Class ---
+class Character {
+public:
+    std::string name;
+    int level;
+    
+    // Using smart pointers for components for ownership and lifetime management
+    std::unique_ptr<HealthComponent> health;
+    std::unique_ptr<ManaComponent> mana;
+    
+    std::vector<std::unique_ptr<Ability>> abilities; // Character owns its abilities
+    std::vector<const Ability*> activeEffects; // Buffs/Debuffs currently applied to this character (not owned)
+
+    // Alternatively, health and mana live in a CombatWorld's dense arrays and
+    // the character only holds a handle to them
+    CombatWorld* world;
+    EntityId entity;
+
+    Position position; // Move through SpatialGrid::move while the character is in a grid
+    Position facing;   // Unit vector, used by cone targeting
+
+    CombatTimers* timers; // When set, drives this character's cooldowns and the effects it casts
+
+    CombatLog* log;        // When set, receives this character's ability uses, damage, healing and mana costs
+    std::uint32_t logId;   // Names the character in log events
+
+    Character(const std::string& name, int level);
+    Character(const std::string& name, int level, CombatWorld& world, EntityId entity);
+    ~Character(); // Destructor to properly clean up unique_ptrs if needed
+
+    void attack(Character& target);
+    void useAbility(const std::string& abilityName, Character& target); // Using string for simplicity to find ability
+    // Or, more robust: void useAbility(Ability& ability, Character& target);
+    void useAbility(AbilityId id, Character& target); // O(1) table lookup, no string work
+    // The checks and costs of useAbility without activating: returns the ability
+    // once its cost is paid and its cooldown started, nullptr if it can't be used
+    const Ability* beginAbility(AbilityId id);
+    const Ability* findAbility(AbilityId id); // Owned abilities first, then learned ones
+
+    // Shares a definition (usually from an AbilityRegistry) instead of owning a copy;
+    // the definition must outlive the character
+    void learnAbility(const Ability& definition);
+
+    // Cooldowns are tracked per character, so definitions can be shared
+    bool isReady(AbilityId id) const;
+    void setReady(AbilityId id, bool ready);
+    const std::vector<AbilityId>& cooldowns() const { return coolingDown; } // Abilities not ready, oldest first
+
+    // What damage calculation needs from a character, derived from its level,
+    // active effects and armor and cached until one of those changes
+    struct DerivedStats {
+        int level;
+        int damageBonusPercent;   // From Buffs on this character, added to its hits
+        int vulnerabilityPercent; // From Debuffs on this character, added to hits on it
+        int armorPercent;         // Damage reduction of its health storage
+    };
+    const DerivedStats& derivedStats() const; // Recomputes first if marked dirty
+    // Buff/Debuff apply and remove and setLevel do this; call it after
+    // changing level, activeEffects, health or entity directly
+    void markStatsDirty() { statsDirty = true; }
+    void setLevel(int newLevel);
+
+    // Back to a just-constructed state under a new name and level, keeping the
+    // components and the capacity of every container (see CharacterPool).
+    // Owned abilities are destroyed; learned ones are forgotten.
+    void reset(const std::string& newName, int newLevel);
+
+    // Facade over whichever storage holds this character's health and mana
+    void takeDamage(int amount);
+    void heal(int amount);
+    bool isAlive() const;
+    bool consumeMana(int amount); // True if the cost was paid (always, without a mana pool)
+    void regenerateMana(int amount);
+    
+private:
+    // Helper to find ability by name, could be made public or part of AbilityManager
+    const Ability* findAbility(const std::string& abilityName);
+
+    std::vector<const Ability*> learnedAbilities; // Shared definitions (not owned)
+    std::vector<AbilityId> coolingDown; // Abilities whose cooldown is running; rarely more than a few
+
+    mutable DerivedStats stats{};
+    mutable bool statsDirty = true;
+
+    // Open-addressing id -> ability table over `abilities` and `learnedAbilities`,
+    // rebuilt automatically when the number of either changes
+    struct AbilitySlot {
+        AbilityId id;
+        const Ability* ability;
+    };
+    std::vector<AbilitySlot> abilityTable;
+    std::size_t indexedAbilityCount = 0;
+    std::size_t indexedLearnedCount = 0;
+    void rebuildAbilityTable();
+};
+
+// --- Health Components ---
+
+class HealthComponent {
+public:
+    virtual ~HealthComponent() = default; // Virtual destructor for proper polymorphic cleanup
+
+    int currentHealth;
+    int maxHealth;
+
+    // Pure virtual functions, must be implemented by subclasses
+    virtual void takeDamage(int amount) = 0;
+    virtual void heal(int amount);
+    virtual bool isAlive() const;
+
+protected:
+    HealthComponent(int maxHp);
+};
+
+class StandardHealth : public HealthComponent {
+public:
+    StandardHealth(int maxHp);
+    void takeDamage(int amount) override;
+};
+
+class ArmoredHealth : public HealthComponent {
+public:
+    static constexpr int damageReductionPercent = 25;
+
+    ArmoredHealth(int maxHp);
+    void takeDamage(int amount) override; // May apply damage reduction
+    static int mitigate(int amount) { return amount - amount * damageReductionPercent / 100; } // Damage left after armor
+};
+
+// --- Mana/Resource Components ---
+
+class ManaComponent {
+public:
+    virtual ~ManaComponent() = default; // Virtual destructor
+
+    int currentMana;
+    int maxMana;
+
+    // Pure virtual functions
+    virtual bool consumeMana(int amount) = 0;
+    virtual void regenerateMana(int amount) = 0;
+
+protected:
+    ManaComponent(int maxResource);
+};
+
+class ArcaneMana : public ManaComponent {
+public:
+    ArcaneMana(int maxResource);
+    bool consumeMana(int amount) override;
+    void regenerateMana(int amount) override;
+};
+
+class RageEnergy : public ManaComponent {
+public:
+    RageEnergy(int maxResource);
+    bool consumeMana(int amount) override; // Renamed for clarity in diagram, but still consumeMana here
+    void regenerateMana(int amount) override; // Might be triggered by combat
+};
+
+// --- Health/Mana Policies ---
+
+// Non-virtual counterparts of the components above, same rules, for
+// archetypes whose combination is known when content is built. Everything is
+// inline, so BasicCharacter's calls compile down to the arithmetic.
+struct StandardHealthPolicy {
+    int currentHealth;
+    int maxHealth;
+
+    explicit StandardHealthPolicy(int maxHp) : currentHealth(maxHp), maxHealth(maxHp) {}
+    void takeDamage(int amount) { currentHealth = std::max(0, currentHealth - amount); }
+    void heal(int amount) { currentHealth = std::min(maxHealth, currentHealth + amount); }
+    bool isAlive() const { return currentHealth > 0; }
+};
+
+struct ArmoredHealthPolicy : StandardHealthPolicy {
+    using StandardHealthPolicy::StandardHealthPolicy;
+    void takeDamage(int amount) { StandardHealthPolicy::takeDamage(ArmoredHealth::mitigate(amount)); }
+};
+
+struct ArcaneManaPolicy {
+    int currentMana;
+    int maxMana;
+
+    explicit ArcaneManaPolicy(int maxResource) : currentMana(maxResource), maxMana(maxResource) {}
+    bool consumeMana(int amount) {
+        if (currentMana < amount) {
+            return false;
+        }
+        currentMana -= amount;
+        return true;
+    }
+    void regenerateMana(int amount) { currentMana = std::min(maxMana, currentMana + amount); }
+};
+
+// Rage starts empty and may be drained by negative amounts
+struct RageEnergyPolicy : ArcaneManaPolicy {
+    explicit RageEnergyPolicy(int maxResource) : ArcaneManaPolicy(maxResource) { currentMana = 0; }
+    void regenerateMana(int amount) { currentMana = std::max(0, std::min(maxMana, currentMana + amount)); }
+};
+
+// Runtime choice of policy without a vtable: calls dispatch on the variant's
+// index, and both alternatives live inline in the character
+struct VariantHealth {
+    std::variant<StandardHealthPolicy, ArmoredHealthPolicy> policy;
+
+    template <typename Policy>
+    VariantHealth(Policy chosen) : policy(chosen) {}
+    void takeDamage(int amount) { std::visit([amount](auto& p) { p.takeDamage(amount); }, policy); }
+    void heal(int amount) { std::visit([amount](auto& p) { p.heal(amount); }, policy); }
+    bool isAlive() const { return std::visit([](const auto& p) { return p.isAlive(); }, policy); }
+};
+
+struct VariantMana {
+    std::variant<ArcaneManaPolicy, RageEnergyPolicy> policy;
+
+    template <typename Policy>
+    VariantMana(Policy chosen) : policy(chosen) {}
+    bool consumeMana(int amount) { return std::visit([amount](auto& p) { return p.consumeMana(amount); }, policy); }
+    void regenerateMana(int amount) { std::visit([amount](auto& p) { p.regenerateMana(amount); }, policy); }
+};
+
+// Character stats with the health and mana rules fixed by template
+// arguments instead of virtual components
+template <typename HealthPolicy, typename ManaPolicy>
+class BasicCharacter {
+public:
+    std::string name;
+    int level;
+    HealthPolicy health;
+    ManaPolicy mana;
+
+    BasicCharacter(const std::string& name, int level, HealthPolicy health, ManaPolicy mana)
+        : name(name), level(level), health(health), mana(mana) {}
+
+    void takeDamage(int amount) { health.takeDamage(amount); }
+    void heal(int amount) { health.heal(amount); }
+    bool isAlive() const { return health.isAlive(); }
+    bool consumeMana(int amount) { return mana.consumeMana(amount); }
+    void regenerateMana(int amount) { mana.regenerateMana(amount); }
+};
+
+using WarriorCharacter = BasicCharacter<ArmoredHealthPolicy, RageEnergyPolicy>;
+using MageCharacter = BasicCharacter<StandardHealthPolicy, ArcaneManaPolicy>;
+using VariantCharacter = BasicCharacter<VariantHealth, VariantMana>; // Combination picked at runtime
+
+// --- Ability Classes ---
+
+class Ability {
+public:
+    virtual ~Ability() = default; // Virtual destructor
+
+    std::string name;
+    AbilityId id; // abilityIdOf(name)
+    const char* spanDetail; // name, interned for trace spans (nullptr without GAME_INSTRUMENTATION)
+    AbilityKind kind;
+    int resourceCost;
+    int cooldown; // Ticks before the ability can be used again (needs Character::timers)
+
+    // Pure virtual function. Const, since one definition may be shared by many characters.
+    virtual void activate(Character& caster, Character& target) const = 0;
+
+protected:
+    // Pointers to collaborators, assuming they are managed externally or passed by ref
+    DamageCalculator* damageCalculator;
+    TargetSelection* targetSelection;
+
+    Ability(const std::string& name, AbilityKind kind, int cost, DamageCalculator* dc, TargetSelection* ts);
+};
+
+class MeleeAttack : public Ability {
+public:
+    int baseDamage;
+    MeleeAttack(int baseDmg, DamageCalculator* dc, TargetSelection* ts);
+    void activate(Character& caster, Character& target) const override;
+};
+
+class SpellCast : public Ability {
+public:
+    std::string spellEffect; // Could be an enum or a more complex effect object
+    int baseDamage;
+    SpellCast(const std::string& effect, DamageCalculator* dc, TargetSelection* ts);
+    void activate(Character& caster, Character& target) const override;
+};
+
+class Buff : public Ability {
+public:
+    std::string effectDescription;
+    int duration;
+    Buff(const std::string& description, int dur);
+    void activate(Character& caster, Character& target) const override;
+    void apply(Character& target) const; // Helper to apply the actual effect
+    void remove(Character& target) const; // Helper to remove the effect
+};
+
+class Debuff : public Ability {
+public:
+    std::string effectDescription;
+    int duration;
+    Debuff(const std::string& description, int dur);
+    void activate(Character& caster, Character& target) const override;
+    void apply(Character& target) const; // Helper to apply the actual effect
+    void remove(Character& target) const; // Helper to remove the effect
+};
+
+// --- Utility Classes ---
+
+class DamageCalculator {
+public:
+    int calculateDamage(const Ability& ability, const Character& caster, const Character& target);
+    // Might have more complex parameters like armor, resistances, etc.
+
+    // The same formula over packed arrays, followed by armor mitigation:
+    //   scaled = base + base * level / 10
+    //   damage = scaled + scaled * bonusPercent / 100   (Buffs on caster, Debuffs on target)
+    //   out    = damage - damage * armorPercent / 100   (ArmoredHealth::damageReductionPercent or 0)
+    // Uses AVX2 or NEON when the build targets them, scalar code otherwise; every
+    // path gives bit-identical results. All inputs must be non-negative.
+    static void calculateDamageBatch(const int* baseDamage, const int* casterLevel, const int* bonusPercent,
+                                     const int* armorPercent, int* out, std::size_t count);
+};
+
+class TargetSelection {
+public:
+    std::vector<Character*> candidates; // Characters in the encounter (not owned)
+
+    // When set, targeting only looks at nearby grid cells instead of every candidate:
+    // "single" is the nearest living character within range, "area" everyone
+    // within range, "cone" everyone within range inside the caster's facing cone
+    SpatialGrid* grid = nullptr;
+    float range = 10.0f;
+    float coneHalfAngleCos = 0.7071f; // cos(45 degrees)
+
+    // Returns a vector of pointers/references to characters that are valid targets
+    std::vector<Character*> selectTargets(Character& caster, const Ability& ability);
+    // Overload for specific targeting types (e.g., single, area, self)
+    std::vector<Character*> selectTargets(Character& caster, const Ability& ability, const std::string& targetType);
+    // Writes up to capacity targets into out instead of allocating; returns how many were written
+    std::size_t selectTargets(Character& caster, const Ability& ability, TargetType targetType,
+                              Character** out, std::size_t capacity);
+    // String form for tooling; parses targetType and forwards
+    std::size_t selectTargets(Character& caster, const Ability& ability, const std::string& targetType,
+                              Character** out, std::size_t capacity);
+};
+
+// Shared, read-only ability definitions. Register everything up front; after
+// that, any number of characters can learn from it, on any thread, without
+// per-character copies of names or collaborator pointers.
+class AbilityRegistry {
+public:
+    // Takes ownership; if the id is already registered, that definition is kept and returned
+    const Ability& add(std::unique_ptr<Ability> definition);
+    const Ability* find(AbilityId id) const;
+    const Ability* find(const std::string& name) const;
+    std::size_t size() const { return definitions.size(); }
+
+private:
+    std::vector<std::unique_ptr<Ability>> definitions;
+    std::unordered_map<AbilityId, const Ability*> byId;
+};
+
+// --- Spatial Index ---
+
+// Uniform grid of character positions. Characters are bucketed by the cell
+// their position falls in; moving only touches the grid when a character
+// crosses into another cell. Queries skip dead characters and the excluded
+// one (usually the caster), write into a caller-provided buffer and return
+// how many characters were written, never more than capacity.
+class SpatialGrid {
+public:
+    explicit SpatialGrid(float cellSize);
+
+    void insert(Character& character);
+    void remove(Character& character);
+    void move(Character& character, Position newPosition);
+    std::size_t size() const { return count; } // Characters inserted
+
+    std::size_t queryRadius(Position center, float radius, const Character* exclude,
+                            Character** out, std::size_t capacity) const;
+    // direction must be a unit vector; minCos is the cosine of the cone's half angle
+    std::size_t queryCone(Position origin, Position direction, float range, float minCos,
+                          const Character* exclude, Character** out, std::size_t capacity) const;
+    // The up to capacity closest characters within maxRadius, nearest first
+    std::size_t queryNearest(Position center, float maxRadius, const Character* exclude,
+                             Character** out, std::size_t capacity) const;
+
+private:
+    float cellSize;
+    float inverseCellSize;
+    std::unordered_map<std::int64_t, std::vector<Character*>> cells;
+    std::size_t count = 0;
+
+    int cellCoordinate(float value) const;
+    static std::int64_t cellKey(int cellX, int cellY);
+    std::int64_t cellKeyOf(Position position) const;
+    const std::vector<Character*>* cellAt(int cellX, int cellY) const;
+};
+
+// --- Timers ---
+
+// Handle to a scheduled timer: low 24 bits node index, high 8 bits generation
+using TimerId = std::uint32_t;
+constexpr TimerId invalidTimer = 0xFFFFFFFFu;
+
+// What happens when a timer fires
+struct TimerEvent {
+    enum class Kind : std::uint8_t { CooldownReady, RemoveEffect };
+    Kind kind;
+    const Ability* ability;
+    Character* character; // The ability's owner for CooldownReady, the effect's target for RemoveEffect
+};
+
+// Hierarchical timing wheel: 4 levels of 64 slots, one tick per level-0
+// slot, covering 2^24 ticks before timers wrap into the top level again.
+// Timers sit in intrusive lists, so schedule and cancel are O(1), and a tick
+// only does work for the slot that comes due (plus an occasional cascade of
+// one higher-level slot down a level). Handles hold a 24-bit node index, so
+// at most maxCapacity timers are pending at once.
+class TimerWheel {
+public:
+    using Tick = std::uint64_t;
+
+    // Index indexMask would make generation 255's handle invalidTimer
+    static constexpr std::uint32_t maxCapacity = (1u << 24) - 1;
+
+    explicit TimerWheel(std::uint32_t capacity = maxCapacity); // Pending timers allowed, at most maxCapacity
+
+    // A delay of 0 fires on the next tick. invalidTimer, scheduling nothing,
+    // once capacity timers are pending.
+    TimerId schedule(std::uint32_t delayTicks, const TimerEvent& event);
+    bool cancel(TimerId id); // False if the timer already fired or was cancelled
+
+    // Advances one tick and calls fire(event) for every timer due
+    template <typename Fire>
+    void advance(Fire fire);
+    // Calls fire(event) for every pending timer now, without advancing
+    template <typename Fire>
+    void expireAll(Fire fire);
+
+    Tick now() const { return currentTick; }
+    std::size_t pending() const { return activeCount; }
+
+private:
+    static constexpr int slotBits = 6;
+    static constexpr std::uint32_t slotCount = 1u << slotBits;
+    static constexpr int levelCount = 4;
+    static constexpr std::uint32_t none = 0xFFFFFFFFu;
+    static constexpr int indexBits = 24;
+    static constexpr std::uint32_t indexMask = (1u << indexBits) - 1;
+
+    struct Node {
+        Tick expiry;
+        TimerEvent event;
+        std::uint32_t prev;
+        std::uint32_t next;
+        std::uint8_t generation;
+        bool active;
+    };
+
+    Tick currentTick = 0;
+    std::size_t activeCount = 0;
+    std::uint32_t capacity;
+    std::vector<Node> nodes;
+    std::vector<std::uint16_t> location; // level * slotCount + slot of each node, so unlink can fix the head
+    std::vector<std::uint32_t> freeNodes;
+    std::uint32_t heads[levelCount][slotCount];
+
+    void place(std::uint32_t index);
+    void link(std::uint32_t index, int level, std::uint32_t slot);
+    void unlink(std::uint32_t index);
+    std::uint32_t detachSlot(int level, std::uint32_t slot);
+    void cascade(int level);
+    void release(std::uint32_t index);
+};
+
+template <typename Fire>
+void TimerWheel::advance(Fire fire) {
+    ++currentTick;
+    for (int level = levelCount - 1; level >= 1; --level) {
+        if ((currentTick & ((Tick(1) << (slotBits * level)) - 1)) == 0) {
+            cascade(level);
+        }
+    }
+    std::uint32_t index = detachSlot(0, static_cast<std::uint32_t>(currentTick & (slotCount - 1)));
+    while (index != none) {
+        std::uint32_t next = nodes[index].next;
+        TimerEvent event = nodes[index].event;
+        release(index);
+        fire(event);
+        index = next;
+    }
+}
+
+template <typename Fire>
+void TimerWheel::expireAll(Fire fire) {
+    for (int level = 0; level < levelCount; ++level) {
+        for (std::uint32_t slot = 0; slot < slotCount; ++slot) {
+            std::uint32_t index = detachSlot(level, slot);
+            while (index != none) {
+                std::uint32_t next = nodes[index].next;
+                TimerEvent event = nodes[index].event;
+                release(index);
+                fire(event);
+                index = next;
+            }
+        }
+    }
+}
+
+// Drives Ability cooldowns and Buff/Debuff expiry from one TimerWheel
+class CombatTimers {
+public:
+    // Marks the ability not ready for owner until ticks have passed; with the
+    // wheel full it stays ready and the result is invalidTimer
+    TimerId startCooldown(Character& owner, const Ability& ability, int ticks);
+    // Calls Buff::remove / Debuff::remove on target after ticks
+    TimerId scheduleEffectExpiry(const Ability& effect, Character& target, int ticks);
+    bool cancel(TimerId id);
+
+    void tick(); // Advances one tick and fires whatever came due
+    void expireAll(); // Ends every pending cooldown and effect now
+
+    TimerWheel wheel;
+};
+
+// --- Encounter Scheduling ---
+
+// Fixed set of threads, each with its own task deque. A worker takes tasks
+// from the back of its own deque and, once that is empty, steals from the
+// front of the others'. The thread calling run() works as well.
+class WorkStealingPool {
+public:
+    explicit WorkStealingPool(unsigned threadCount); // Total, including the caller; 0 means one per core
+    ~WorkStealingPool();
+
+    // Calls task(i) for every i below taskCount and returns once all are done
+    void run(std::size_t taskCount, const std::function<void(std::size_t)>& task);
+    unsigned threadCount() const { return static_cast<unsigned>(queues.size()); }
+
+private:
+    struct TaskQueue {
+        std::mutex mutex;
+        std::deque<std::size_t> tasks;
+    };
+    std::vector<std::unique_ptr<TaskQueue>> queues; // Queue 0 belongs to the calling thread
+    std::vector<std::thread> workers;
+
+    std::mutex stateMutex;
+    std::condition_variable wake;
+    std::condition_variable done;
+    const std::function<void(std::size_t)>* current = nullptr;
+    std::uint64_t runGeneration = 0;
+    std::size_t remaining = 0;
+    bool stopping = false;
+
+    void workerLoop(unsigned self);
+    void work(unsigned self);
+    bool take(unsigned self, std::size_t& task);
+};
+
+// One use of an ability, queued for the next tick
+struct CombatAction {
+    Character* caster;
+    AbilityId ability;
+    Character* target;
+};
+
+// What one group does to a character outside it, held until the barrier
+struct DeferredCommand {
+    enum class Kind : std::uint8_t { Ability, Damage, Heal };
+    Kind kind;
+    Character* caster; // Ability only
+    Character* target;
+    const Ability* ability; // Ability only, already paid for by the caster
+    int amount;        // Damage and Heal only
+};
+
+// Characters that only touch each other during a tick, so the group can run
+// on any thread. Members' timers are the group's own.
+class CombatGroup {
+public:
+    std::uint32_t index;
+    std::vector<Character*> members;
+    std::vector<CombatAction> actions; // Run in order on the next tick, then cleared
+    CombatTimers timers;
+
+    bool contains(const Character& character) const;
+    // Applied now when target is in this group, otherwise at the barrier
+    void damage(Character& target, int amount);
+    void heal(Character& target, int amount);
+
+private:
+    friend class EncounterScheduler;
+    const EncounterScheduler* scheduler = nullptr;
+    std::vector<DeferredCommand> deferred;
+
+    void tick();
+};
+
+// Runs many independent encounters per tick on a WorkStealingPool:
+//   1. every group runs its actions and timers, in parallel, touching only
+//      its own members
+//   2. barrier: commands aimed across groups are applied on the calling
+//      thread, in group order and then queue order
+// Nothing depends on which thread ran which group, so results are the same
+// for any thread count. Characters sharing a CombatWorld may sit in different
+// groups (they write different slots), but nothing may spawn or despawn
+// during tick().
+class EncounterScheduler {
+public:
+    static constexpr std::uint32_t noGroup = 0xFFFFFFFFu;
+
+    explicit EncounterScheduler(unsigned threadCount = 0);
+
+    // Characters linked by engagements, directly or through others, share a
+    // group; a character without any gets a group of its own. Replaces any
+    // previous grouping, ending the old groups' cooldowns and effects early.
+    void partition(const std::vector<Character*>& characters,
+                   const std::vector<std::pair<Character*, Character*>>& engagements);
+
+    std::size_t groupCount() const { return groups.size(); }
+    CombatGroup& group(std::size_t index) { return *groups[index]; }
+    std::uint32_t groupOf(const Character& character) const; // noGroup if not partitioned
+
+    void queueAction(Character& caster, AbilityId ability, Character& target); // caster must be partitioned
+    void tick();
+
+private:
+    WorkStealingPool pool;
+    std::vector<std::unique_ptr<CombatGroup>> groups; // Stable addresses for members' timers
+    std::unordered_map<const Character*, std::uint32_t> groupIndex;
+
+    void applyDeferred(const DeferredCommand& command);
+};
+
+// --- Batch Damage ---
+
+// One resolved hit: the caster's ability lands on the target. Costs,
+// cooldowns and liveness are checked before a hit is recorded.
+struct HitRecord {
+    Character* caster;
+    Character* target;
+    const Ability* ability;
+};
+
+// Resolves many hits at once in stages instead of one
+// activate -> calculateDamage -> takeDamage chain per hit:
+//   gather    - read per-hit inputs into packed arrays, group hits by target type
+//   calculate - DamageCalculator::calculateDamageBatch, which also applies
+//               ArmoredHealth's reduction through the per-hit armor percent
+//   apply     - subtract from current health, grouped by where health lives
+// The stage loops make no virtual calls. Within one batch every hit is
+// resolved, even if an earlier hit in the batch killed its caster, and the
+// result matches applying the hits one by one in any order.
+class DamagePipeline {
+public:
+    void resolve(const HitRecord* hits, std::size_t count);
+    void resolve(const std::vector<HitRecord>& hits) { resolve(hits.data(), hits.size()); }
+
+    // Damage dealt per hit by the last resolve(), after mitigation
+    const std::vector<int>& damageDealt() const { return damage; }
+    // Hits of the last resolve() that took their target from alive to dead
+    const std::vector<HitRecord>& killingHits() const { return kills; }
+
+private:
+    // Scratch arrays reused across batches so steady-state ticks don't allocate
+    std::vector<int> baseDamage;
+    std::vector<int> casterLevel;
+    std::vector<int> bonusPercent;
+    std::vector<int> armorPercent;
+    std::vector<int> damage;
+    std::vector<std::uint32_t> worldHits;      // Hit indices whose target lives in a CombatWorld
+    std::vector<std::uint32_t> componentHits;  // Hit indices whose target owns a HealthComponent
+    std::vector<HitRecord> kills;
+
+    void gather(const HitRecord* hits, std::size_t count);
+    void calculate();
+    void apply(const HitRecord* hits);
+};
+
+// --- Ability Scripts ---
+
+// An ability defined by data instead of a subclass. Its statements are
+// compiled once into a flat stack-machine program; the interpreter runs
+// each instruction across a whole batch of casts (up to `lanes` at a time)
+// before the next, so dispatch is paid per batch rather than per cast.
+// Within a batch each statement finishes for every cast before the next
+// statement starts; one cast alone behaves like one activate().
+class ScriptedAbility : public Ability {
+public:
+    enum class Op : std::uint8_t {
+        Push,    // operand: constant
+        Load,    // operand: Variable
+        Add, Subtract, Multiply, Divide, Min, Max, Negate, // Dividing by zero gives 0
+        AddConstant, MultiplyConstant, DivideConstant,     // operand: right-hand constant
+        Damage,  // Pops; target.takeDamage if positive
+        Heal,    // Pops; target.heal if positive
+        Restore, // Pops; caster.regenerateMana
+        Effect,  // operand: index into effects, activated on the target
+    };
+
+    enum class Variable : std::uint8_t {
+        Level, TargetLevel,
+        Bonus, // Caster's damage bonus plus target's vulnerability, in percent
+        Health, MaxHealth, TargetHealth, TargetMaxHealth, Mana,
+    };
+
+    struct Instruction {
+        Op op;
+        std::int32_t operand;
+    };
+
+    static constexpr std::size_t maxStackDepth = 16;
+    static constexpr std::size_t lanes = 64;
+
+    TargetType targetType;  // How the script asks to be targeted; callers choose the targets
+    bool dealsDamage;       // Has a damage statement
+    std::vector<Instruction> program;
+    std::vector<const Ability*> effects; // Buff/Debuff definitions named by the script (not owned)
+
+    explicit ScriptedAbility(const std::string& name);
+    void activate(Character& caster, Character& target) const override;
+    // Every cast must be of this ability. With kills, appends each cast whose
+    // damage took its target from alive to dead.
+    void activateBatch(const HitRecord* casts, std::size_t count, std::vector<HitRecord>* kills = nullptr) const;
+};
+
+// Collects casts of any scripted abilities, then runs them with one
+// activateBatch per ability. Buffers are reused from run to run.
+class ScriptedCastBatch {
+public:
+    void add(const HitRecord& cast) { casts.push_back(cast); } // cast.ability must be a ScriptedAbility
+    void run(); // Each ability's casts in the order added, abilities by id; then empties the batch
+    bool empty() const { return casts.empty(); }
+    // Casts of the last run() that took their target from alive to dead
+    const std::vector<HitRecord>& killingHits() const { return kills; }
+
+private:
+    std::vector<HitRecord> casts;
+    std::vector<HitRecord> grouped;
+    std::vector<HitRecord> kills;
+    std::vector<std::uint64_t> keys; // Ability id, then position in casts
+};
+
+// Compiles ability definitions written as text and adds them to the registry,
+// together with any buffs and debuffs they name that it doesn't have yet.
+// One ability per block, one statement per line, '#' starts a comment:
+//
+//   ability Frostbolt
+//   cost 15                 # Mana or rage, 0 by default
+//   cooldown 3              # Ticks, 0 by default
+//   target single           # self | single | area | cone
+//   damage (12 + 2 * level) * (100 + bonus) / 100
+//   debuff Chilled 4        # Effect name, duration in ticks
+//
+// Statements run in order: damage, heal and restore take an integer
+// expression over + - * / ( ), min(a, b), max(a, b), constants and the
+// variables level, target_level, bonus, health, max_health, target_health,
+// target_max_health and mana (the caster's unless prefixed target_); buff and
+// debuff apply an effect. Returns false with "line N: ..." in error on the
+// first mistake, having added nothing; an ability already in the registry is
+// a mistake too.
+bool loadAbilityScript(const std::string& source, AbilityRegistry& registry, std::string& error);
+
+// --- Action Queue ---
+
+// One player action as submitted by a network thread
+struct ActionRecord {
+    EntityId caster;
+    AbilityId ability;
+    EntityId target;
+    std::uint32_t timestamp; // Client tick the action was issued on
+};
+
+// Bounded multi-producer, single-consumer ring of ActionRecords. Any thread
+// may push without taking a lock; only the combat tick drains. Each cell has a
+// sequence number saying whether it is free for the producer of that lap or
+// filled for the consumer, so producers only contend on one counter.
+class ActionQueue {
+public:
+    explicit ActionQueue(std::size_t capacity); // Rounded up to a power of two
+
+    bool push(const ActionRecord& action); // False when full; the caller decides whether to drop or retry
+    std::size_t drain(ActionRecord* out, std::size_t maxCount); // Consumer thread only
+    std::size_t capacity() const { return cells.size(); }
+
+private:
+    struct Cell {
+        std::atomic<std::size_t> sequence;
+        ActionRecord action;
+    };
+    std::vector<Cell> cells;
+    std::size_t mask;
+    alignas(64) std::atomic<std::size_t> enqueuePosition{0};
+    alignas(64) std::size_t dequeuePosition = 0; // Consumer only
+};
+
+// Drains an ActionQueue once per tick and resolves the batch:
+//   - records are ordered by (timestamp, caster, ability, target) so the
+//     outcome doesn't depend on how producers raced
+//   - each is validated against the bound characters: both ids current, then
+//     the same checks and costs as useAbility (Character::beginAbility)
+//   - Buffs and Debuffs activate during validation, so they count towards
+//     the damage of the same batch
+//   - scripted abilities run next, one ScriptedAbility::activateBatch each
+//   - every damaging action becomes a HitRecord for one DamagePipeline pass
+class ActionBatch {
+public:
+    // Characters must live in a CombatWorld to be addressed by EntityId
+    void bind(Character& character);
+    void unbind(Character& character);
+
+    // Returns how many actions passed validation
+    std::size_t process(ActionQueue& queue, DamagePipeline& pipeline);
+
+    std::size_t maxBatch = 4096; // Records drained per process() call
+
+private:
+    std::vector<Character*> byIndex; // Entity index -> bound character
+    std::vector<ActionRecord> drained;
+    std::vector<HitRecord> hits;
+    ScriptedCastBatch scripted;
+
+    Character* resolve(EntityId id) const;
+};
+
+// --- Entity-Component Storage ---
+
+enum class HealthKind : std::uint8_t { Standard, Armored };
+enum class ManaKind : std::uint8_t { Arcane, Rage };
+
+// Health of every entity in one set of parallel arrays, indexed by dense slot
+struct HealthStorage {
+    std::vector<int> currentHealth;
+    std::vector<int> maxHealth;
+    std::vector<HealthKind> kind;
+};
+
+// Mana/rage of every entity, same dense slots as HealthStorage
+struct ManaStorage {
+    std::vector<int> currentMana;
+    std::vector<int> maxMana;
+    std::vector<ManaKind> kind;
+    std::vector<std::uint8_t> combatTicks; // Ticks until out of combat; 0 when out
+};
+
+// Per-tick resource changes applied by CombatWorld::regenerate
+struct RegenerationRates {
+    int arcanePerTick;     // Mana regained, in or out of combat
+    int ragePerTick;       // Rage gained while in combat
+    int rageDecayPerTick;  // Rage lost out of combat
+};
+
+// Owns the components of many entities in dense per-type arrays, so per-tick
+// systems walk contiguous memory with no pointer chasing or virtual calls.
+// Despawning moves the last entity into the freed slot; EntityIds stay valid
+// through that, and a despawned id is rejected even after its index is reused.
+class CombatWorld {
+public:
+    HealthStorage health;
+    ManaStorage mana;
+    std::vector<EntityId> entities; // Dense slot -> id
+
+    EntityId spawn(HealthKind healthKind, int maxHp, ManaKind manaKind, int maxResource);
+    void despawn(EntityId id);
+    bool isValid(EntityId id) const;
+    std::size_t slotOf(EntityId id) const; // id must be valid
+    std::size_t size() const { return entities.size(); }
+
+    // Same rules as the StandardHealth/ArmoredHealth and ArcaneMana/RageEnergy
+    // components. A stale or despawned id is ignored (consumeMana fails).
+    void takeDamage(EntityId id, int amount);
+    void heal(EntityId id, int amount);
+    bool isAlive(EntityId id) const;
+    bool consumeMana(EntityId id, int amount);
+    void regenerateMana(EntityId id, int amount);
+
+    // Taking damage or paying for an ability keeps an entity in combat this
+    // many ticks (at most 255)
+    std::uint8_t combatTimeoutTicks = 5;
+    void enterCombat(std::size_t slot) { mana.combatTicks[slot] = combatTimeoutTicks; }
+    bool inCombat(EntityId id) const { return isValid(id) && mana.combatTicks[slotOf(id)] > 0; }
+
+    // Systems: one pass over the dense arrays
+    void applyDamageOverTime(int amount); // Every living entity, armor applies
+    void regenerateAll(int amount);       // Every entity's mana or rage, clamped to [0, max]
+    // One tick of regeneration for every entity by its kind and combat state,
+    // clamped to [0, max], then one tick off every combat timer. With AVX2 or
+    // NEON, eight entities take a handful of vector instructions.
+    void regenerate(const RegenerationRates& rates);
+
+private:
+    static constexpr int indexBits = 24;
+    static constexpr EntityId indexMask = (1u << indexBits) - 1;
+
+    std::vector<std::uint32_t> slotOfIndex;  // Entity index -> dense slot
+    std::vector<std::uint8_t> generationOf;  // Entity index -> current generation
+    std::vector<std::uint32_t> freeIndices;
+};
+
+// --- Character Pool ---
+
+// What every character from one pool looks like
+struct CharacterArchetype {
+    HealthKind healthKind;
+    int maxHealth;
+    ManaKind manaKind;
+    int maxResource;
+    std::vector<const Ability*> abilities; // Shared definitions, learned on every spawn
+};
+
+// Recycles Characters of one archetype. Released characters keep their
+// name buffer, components and container capacity, and the next spawn resets
+// them in place, so a wave of spawns after a wave of deaths doesn't touch the
+// allocator. Up to highWaterMark released characters are kept; beyond that
+// they are destroyed.
+//
+// With a CombatWorld, characters hold no components: spawn and release
+// spawn and despawn their entity instead.
+//
+// Release a character only once nothing refers to it any more: out of any
+// SpatialGrid, TargetSelection or EncounterScheduler, and with no pending
+// timers for it (e.g. after CombatTimers::expireAll).
+class CharacterPool {
+public:
+    struct Stats {
+        std::size_t hits;      // Spawns served by a recycled character
+        std::size_t misses;    // Spawns that had to allocate one
+        std::size_t released;  // Characters returned to the pool
+        std::size_t discarded; // Releases destroyed for being over the high-water mark
+    };
+
+    CharacterPool(CharacterArchetype archetype, std::size_t preallocate, std::size_t highWaterMark,
+                  CombatWorld* world = nullptr);
+
+    std::unique_ptr<Character> spawn(const std::string& name, int level);
+    void release(std::unique_ptr<Character> character);
+
+    std::size_t available() const { return pooled.size(); }
+    std::size_t getHighWaterMark() const { return highWaterMark; }
+    void setHighWaterMark(std::size_t mark); // Destroys pooled characters above the new mark
+    const Stats& getStats() const { return stats; }
+
+private:
+    CharacterArchetype archetype;
+    std::size_t highWaterMark;
+    CombatWorld* world;
+    std::vector<std::unique_ptr<Character>> pooled;
+    Stats stats{};
+
+    std::unique_ptr<Character> create();
+    void prepare(Character& character, const std::string& name, int level);
+};
+
+// --- Replication ---
+
+// Bits, least significant first, into a caller's buffer. Running out of room
+// sets overflowed and drops the rest instead of writing past the end.
+class BitWriter {
+public:
+    BitWriter(std::uint8_t* buffer, std::size_t capacity) : buffer(buffer), capacity(capacity) {}
+
+    void write(std::uint32_t value, unsigned bits); // bits <= 32
+    void writeVarUint(std::uint32_t value);          // 4-bit groups, each followed by a continue bit
+    void writeVarInt(std::int32_t value);            // Zigzag, then writeVarUint
+    std::size_t finish();                              // Flushes; bytes written, 0 if overflowed
+    bool overflowed() const { return overflow; }
+
+private:
+    std::uint8_t* buffer;
+    std::size_t capacity;
+    std::size_t size = 0;
+    std::uint64_t pending = 0;
+    unsigned pendingBits = 0;
+    bool overflow = false;
+};
+
+// Reads what BitWriter wrote. Reading past the end yields zeros and sets exhausted.
+class BitReader {
+public:
+    BitReader(const std::uint8_t* data, std::size_t size) : data(data), size(size) {}
+
+    std::uint32_t read(unsigned bits);
+    std::uint32_t readVarUint();
+    std::int32_t readVarInt();
+    bool exhausted() const { return overrun; }
+    std::size_t remainingBits() const { return (size - offset) * 8 + (overrun ? 0 : pendingBits); }
+
+private:
+    const std::uint8_t* data;
+    std::size_t size;
+    std::size_t offset = 0;
+    std::uint64_t pending = 0;
+    unsigned pendingBits = 0;
+    bool overrun = false;
+};
+
+// Encodes the replicated state of a fixed list of characters: health, mana,
+// running cooldowns and active effects. A snapshot carries everything and
+// becomes the baseline; a delta carries only the characters, and only the
+// fields, that changed since the last message encoded, so its size follows
+// what happened that tick rather than the population. The character at
+// position i of the list is replica i: keep the list stable between
+// snapshots and send a new snapshot whenever it changes.
+//
+// Message: 1 bit kind (0 snapshot, 1 delta), 32 bits tick, varuint record
+// count, then records.
+//   Snapshot record: varuint maxHealth, varint currentHealth, varuint maxMana,
+//     varint currentMana, cooldown list, effect list
+//   Delta record: varuint gap to the previous changed index, 5-bit change
+//     mask, then varint differences for changed health/mana, varuint maxima
+//     and the new lists as in a snapshot
+//   List: varuint count, 32 bits per AbilityId
+//
+// Encoding never allocates: every buffer is sized in the constructor.
+class ReplicationEncoder {
+public:
+    static constexpr std::size_t maxIdsPerList = 16; // Longer cooldown/effect lists replicate their first 16
+
+    explicit ReplicationEncoder(std::size_t maxCharacters);
+
+    // Both return the bytes written, or 0 if they don't fit in capacity (the
+    // baseline is then untouched, so retry with a bigger buffer or next tick).
+    // encodeDelta also returns 0 without a baseline for this many characters.
+    std::size_t encodeSnapshot(const std::vector<Character*>& characters, std::uint32_t tick,
+                               std::uint8_t* buffer, std::size_t capacity);
+    std::size_t encodeDelta(const std::vector<Character*>& characters, std::uint32_t tick,
+                            std::uint8_t* buffer, std::size_t capacity);
+
+private:
+    struct IdList {
+        std::uint32_t count;
+        AbilityId ids[maxIdsPerList];
+    };
+
+    struct Replicated {
+        int currentHealth;
+        int maxHealth;
+        int currentMana;
+        int maxMana;
+        IdList cooldowns;
+        IdList effects;
+    };
+
+    std::size_t maxCharacters;
+    std::vector<Replicated> baseline; // As last encoded, by replica index
+    std::size_t baselineCount = 0;
+    bool hasBaseline = false;
+    std::vector<Replicated> changedState; // This delta's changed records...
+    std::vector<std::uint32_t> changedIndex; // ...and their replica indices
+
+    static void capture(const Character& character, Replicated& state);
+};
+
+// Client side: rebuilds the replicated state from snapshots and deltas
+class ReplicationDecoder {
+public:
+    struct State {
+        int currentHealth;
+        int maxHealth;
+        int currentMana;
+        int maxMana;
+        std::vector<AbilityId> cooldowns;
+        std::vector<AbilityId> effects;
+    };
+
+    // False on a malformed message or a delta before any snapshot; the state
+    // is then unreliable until the next snapshot
+    bool apply(const std::uint8_t* data, std::size_t size);
+
+    const std::vector<State>& states() const { return replicas; }
+    std::uint32_t tick() const { return lastTick; }
+
+private:
+    std::vector<State> replicas;
+    std::uint32_t lastTick = 0;
+    bool hasSnapshot = false;
+};
+
+// --- Combat Log ---
+
+// One audited action as a fixed-size POD record. attack() is a UseAbility of
+// meleeAttackId.
+struct CombatEvent {
+    enum class Kind : std::uint8_t { UseAbility, TakeDamage, Heal, ConsumeMana };
+
+    std::uint32_t tick;
+    std::uint32_t actor;  // Character::logId
+    std::uint32_t target; // The actor itself for everything but UseAbility
+    AbilityId ability;    // UseAbility only
+    std::int32_t amount;  // Damage, healing or cost as handed to the health/mana storage
+    std::int32_t result;  // UseAbility/ConsumeMana: 1 if it went ahead; TakeDamage/Heal: health after
+    Kind kind;
+    std::uint8_t thread;  // Ring it came through, in order of each thread's first event
+};
+
+// Event stream for dispute resolution and balancing analytics. Recording
+// copies the event into the calling thread's ring buffer and nothing else:
+// no lock, allocation or I/O on the simulation threads, and a full ring drops
+// the event (counted) rather than wait. A background writer drains the rings
+// every flushInterval (at once while a ring is over half full) into blocks
+// of up to blockEvents events, stored column
+// by column: each column delta/zigzag-varint or run-length coded, ability ids
+// through a per-block dictionary. Files are path.0, path.1, ..., each started
+// once the current one reaches rotateBytes.
+//
+// Events from one thread keep their order; across threads, order by tick.
+class CombatLog {
+public:
+    struct Options {
+        std::string path;
+        std::size_t ringCapacity;  // Events per thread, rounded up to a power of two
+        std::size_t blockEvents;
+        std::size_t rotateBytes;
+        std::chrono::milliseconds flushInterval;
+    };
+
+    struct Stats {
+        std::uint64_t recorded;
+        std::uint64_t dropped; // Found its ring full
+        std::uint64_t written;
+        std::uint64_t blocks;
+        std::uint64_t files;
+        std::uint64_t bytes;
+        std::uint64_t failedWrites;
+    };
+
+    static Options defaultOptions(const std::string& path); // 64k-event rings, 4k-event blocks, 64 MiB files, 5 ms
+
+    explicit CombatLog(Options options); // Starts the writer
+    ~CombatLog();                        // Writes everything recorded, then stops it
+
+    CombatLog(const CombatLog&) = delete;
+    CombatLog& operator=(const CombatLog&) = delete;
+
+    void setTick(std::uint32_t tick) { currentTick.store(tick, std::memory_order_relaxed); }
+    void record(CombatEvent event); // Fills in tick and thread
+    void recordAbility(const Character& caster, AbilityId ability, const Character& target, bool used);
+
+    void flush(); // Returns once everything recorded before the call is in a file
+    Stats stats() const;
+
+    // Appends the events of one file; false if it can't be opened or is malformed
+    static bool readFile(const std::string& path, std::vector<CombatEvent>& events);
+
+private:
+    struct Ring;
+
+    Options options;
+    std::uint64_t serial; // Tells thread-local ring caches apart from a previous log at the same address
+    std::atomic<std::uint32_t> currentTick{0};
+
+    mutable std::mutex mutex; // Guards rings, the flush counters and stopping
+    std::condition_variable wake;
+    std::condition_variable flushed;
+    std::vector<std::unique_ptr<Ring>> rings;
+    std::uint64_t flushRequested = 0;
+    std::uint64_t flushCompleted = 0;
+    bool stopping = false;
+
+    // Writer thread only; the encode buffers are reused from block to block
+    std::vector<CombatEvent> block;
+    std::vector<AbilityId> dictionary;
+    static constexpr std::size_t columnCount = 8;
+    std::vector<std::uint8_t> columns[columnCount];
+    std::vector<std::uint8_t> blockBytes;
+    std::FILE* file = nullptr;
+    std::size_t fileBytes = 0;
+    std::uint32_t fileIndex = 0;
+    std::atomic<std::uint64_t> written{0};
+    std::atomic<std::uint64_t> blocks{0};
+    std::atomic<std::uint64_t> files{0};
+    std::atomic<std::uint64_t> bytes{0};
+    std::atomic<std::uint64_t> failedWrites{0};
+
+    std::thread writer;
+
+    Ring& localRing();
+    void writerLoop();
+    bool drain(Ring& ring); // True if the ring was over half full
+    void writeBlock();
+};
+
+// --- Loot ---
+
+struct LootEntry {
+    std::string item;
+    std::uint32_t chancePerMille; // Chance to drop on each kill
+    int minQuantity;
+    int maxQuantity;
+    std::int64_t priceCents; // Unit price the item enters an inventory with
+};
+
+struct LootTable {
+    std::vector<LootEntry> entries;
+};
+
+// One rolled stack; Inventory::add_loot turns a batch of these into add_bulk entries
+struct LootDrop {
+    const LootEntry* entry;
+    int quantity;
+};
+
+// Keeps loot off the combat tick: during the tick a kill is one append, and
+// after it distribute() rolls every kill's table in one pass, groups the
+// drops by recipient and hands each recipient its drops as one batch, for a
+// single bulk insert into their inventory instead of one add per drop.
+// Rolls come from the pipeline's own seeded generator, so a replayed fight
+// drops the same loot. Single-threaded: record and distribute from the
+// thread that owns the characters. Killers and tables must outlive the
+// distribute() that covers their kills.
+class LootPipeline {
+public:
+    explicit LootPipeline(std::uint64_t seed);
+
+    void recordKill(Character& killer, const LootTable& table);
+    void recordKills(const std::vector<HitRecord>& killingHits, const LootTable& table); // e.g. DamagePipeline::killingHits
+    std::size_t pendingKills() const { return kills.size(); }
+
+    // Calls deliver(Character& recipient, const LootDrop* drops, std::size_t count)
+    // once per recipient that got anything, in order of their first kill, with
+    // their drops in roll order; clears the kills. Returns the drop count.
+    template <typename Deliver>
+    std::size_t distribute(Deliver deliver);
+
+private:
+    struct Kill {
+        Character* killer;
+        const LootTable* table;
+    };
+
+    std::vector<Kill> kills;
+    std::uint64_t rngState;
+    // Reused from tick to tick, so distributing allocates nothing once warm
+    std::vector<std::pair<const Character*, std::uint32_t>> byKiller; // (killer, kill index), sorted
+    std::vector<std::uint32_t> firstKill; // Per kill, the killer's first kill: their place in the order
+    std::vector<std::uint64_t> keys;      // First kill, then roll index
+    std::vector<LootDrop> rolled;
+    std::vector<LootDrop> grouped;
+    std::vector<Character*> recipients;
+    std::vector<std::size_t> groupStart;  // Per recipient, into grouped; one extra at the end
+
+    std::uint32_t nextRandom();
+    void roll(); // Fills grouped and groupStart from kills
+};
+
+template <typename Deliver>
+std::size_t LootPipeline::distribute(Deliver deliver) {
+    roll();
+    for (std::size_t r = 0; r < recipients.size(); ++r) {
+        deliver(*recipients[r], grouped.data() + groupStart[r], groupStart[r + 1] - groupStart[r]);
+    }
+    return grouped.size();
+}
+
 #endif // GAME_COMBAT_SYSTEM_H
\ No newline at end of file
@@ -0,0 +1,876 @@
+// combat_simulator.cpp
+// Headless, seeded fights over the combat classes, for measuring them.
+// Build together with the combat system, e.g.
+//   g++ -std=c++17 -O2 -pthread "Combat Simulator.cpp" "Class Definition.cpp" -o combat_sim
+// and run ./combat_sim --help for the options.
+#include "Class Definition.h"
+#include "Instrumentation.h"
+
+#include <atomic> // For the allocation counter
+#include <chrono> // For tick timing
+#include <cstdio> // For std::printf
+#include <cstdlib> // For std::malloc, std::free, std::strtoul
+#include <cstring> // For std::memcpy in the self-test
+#include <fstream> // For reading ability scripts
+#include <new> // For std::bad_alloc
+#include <random> // For std::mt19937
+#include <sstream> // For reading ability scripts
+#include <string_view> // For argument parsing
+#include <unistd.h> // For close / unlink / rmdir of the self-test's files
+
+// Every allocation in the process goes through here, so the report can show
+// allocations per tick
+namespace {
+std::atomic<std::uint64_t> allocationCount{0};
+}
+
+void* operator new(std::size_t size) {
+    allocationCount.fetch_add(1, std::memory_order_relaxed);
+    if (void* memory = std::malloc(size ? size : 1)) {
+        return memory;
+    }
+    throw std::bad_alloc();
+}
+
+// Once operator new and delete are inlined into one function, GCC sees a
+// new-expression's memory reach free() and reports a mismatch. Both sides
+// use malloc/free, so the warning is a false positive.
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+#endif
+void operator delete(void* memory) noexcept {
+    std::free(memory);
+}
+
+void operator delete(void* memory, std::size_t) noexcept {
+    std::free(memory);
+}
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic pop
+#endif
+
+namespace {
+
+// Damage goes straight through Character::useAbility-style activation, or is
+// collected into HitRecords and resolved by one DamagePipeline pass per tick
+enum class Path { Direct, Batch };
+
+// One thing a character may do on its turn
+struct Move {
+    AbilityId ability;
+    TargetType targetType;
+};
+
+struct TeamSetup {
+    int size;
+    int maxHealth;
+    int maxResource;
+    bool casters;     // Arcane mana and spells; otherwise rage and melee
+    float arenaSize;  // Spawned uniformly in a square of this side
+    float range;      // Targeting range
+};
+
+struct Scenario {
+    const char* name;
+    TeamSetup teams[2];
+};
+
+// 1v1 duel, a 40v40 raid in one arena, and a few casters hitting everything
+// around them in a field of ten thousand mobs
+const Scenario scenarios[] = {
+    {"1v1", {{1, 500, 200, true, 4.0f, 10.0f}, {1, 500, 100, false, 4.0f, 10.0f}}},
+    {"raid", {{40, 800, 300, true, 30.0f, 40.0f}, {40, 800, 100, false, 30.0f, 40.0f}}},
+    {"aoe", {{10, 1000000, 100000, true, 300.0f, 15.0f}, {10000, 100, 100, false, 300.0f, 2.0f}}},
+};
+
+constexpr AbilityId fireballId = abilityIdOf("Fireball");
+constexpr AbilityId blizzardId = abilityIdOf("Blizzard");
+constexpr AbilityId rallyId = abilityIdOf("Rally");
+constexpr AbilityId curseId = abilityIdOf("Curse");
+
+const Move casterMoves[] = {
+    {fireballId, TargetType::Single}, {blizzardId, TargetType::Area}, {blizzardId, TargetType::Area},
+    {curseId, TargetType::Single},
+};
+const Move fighterMoves[] = {
+    {meleeAttackId, TargetType::Single}, {meleeAttackId, TargetType::Single}, {meleeAttackId, TargetType::Single},
+    {rallyId, TargetType::Self},
+};
+
+// What every kill drops, with --loot
+const LootTable lootTable{{
+    {"Gold Coin", 1000, 1, 20, 1},
+    {"Health Potion", 250, 1, 2, 500},
+    {"Rune Fragment", 50, 1, 1, 2500},
+}};
+
+class Simulation {
+public:
+    // With a log, character i of encounter k is logged as (k << 20) | i.
+    // abilityScript (possibly empty) is loaded before the built-in abilities,
+    // so it can replace them by defining abilities of the same names.
+    // With loot, kills are recorded during the tick for distributeLoot().
+    Simulation(const Scenario& scenario, std::uint32_t seed, Path path, CombatLog* log, std::uint32_t encounter,
+               const std::string& abilityScript, bool lootEnabled);
+
+    void tick();
+    // Rolls and hands out the loot of the last tick's kills, outside tick()
+    void distributeLoot();
+
+    std::uint64_t hits = 0;   // Damaging ability applications
+    std::uint64_t kills = 0;  // Characters that died (and respawned)
+    std::uint64_t lootDrops = 0;
+    std::uint64_t lootDeliveries = 0; // Batches handed to a recipient
+    std::int64_t lootCents = 0;
+
+    // Cheap fingerprint of the state, to check runs with the same seed agree
+    std::uint64_t checksum() const;
+
+private:
+    struct Team {
+        std::vector<Character*> members;
+        TargetSelection targeting; // Looks into the other team's grid
+        const Move* moves;
+        std::size_t moveCount;
+    };
+
+    Path path;
+    bool lootEnabled;
+    std::mt19937 rng;
+    DamageCalculator calculator;
+    AbilityRegistry registry;
+    CombatWorld world;
+    CombatTimers timers;
+    SpatialGrid grids[2] = {SpatialGrid(5.0f), SpatialGrid(5.0f)};
+    Team teams[2];
+    std::vector<std::unique_ptr<Character>> characters;
+    std::vector<Character*> targets;
+    std::vector<HitRecord> pendingHits;
+    DamagePipeline pipeline;
+    ScriptedCastBatch scriptedCasts;
+    LootPipeline loot;
+
+    void act(Team& team, Character& caster);
+    void wander(Character& character, SpatialGrid& grid);
+};
+
+Simulation::Simulation(const Scenario& scenario, std::uint32_t seed, Path path, CombatLog* log, std::uint32_t encounter,
+                       const std::string& abilityScript, bool lootEnabled)
+    : path(path), lootEnabled(lootEnabled), rng(seed), loot(seed) {
+    std::string error;
+    loadAbilityScript(abilityScript, registry, error); // Checked in main
+    registry.add(std::make_unique<MeleeAttack>(10, &calculator, nullptr));
+    registry.add(std::make_unique<SpellCast>("Fireball", &calculator, nullptr));
+    registry.add(std::make_unique<SpellCast>("Blizzard", &calculator, nullptr));
+    auto rally = std::make_unique<Buff>("Rally", 5);
+    rally->cooldown = 10;
+    registry.add(std::move(rally));
+    auto curse = std::make_unique<Debuff>("Curse", 5);
+    curse->cooldown = 8;
+    registry.add(std::move(curse));
+
+    std::size_t largestTeam = 0;
+    for (int t = 0; t < 2; ++t) {
+        const TeamSetup& setup = scenario.teams[t];
+        Team& team = teams[t];
+        team.moves = setup.casters ? casterMoves : fighterMoves;
+        team.moveCount = 4;
+        team.targeting.grid = &grids[1 - t];
+        team.targeting.range = setup.range;
+        for (int i = 0; i < setup.size; ++i) {
+            EntityId entity = world.spawn(i % 2 ? HealthKind::Armored : HealthKind::Standard, setup.maxHealth,
+                                          setup.casters ? ManaKind::Arcane : ManaKind::Rage, setup.maxResource);
+            auto character = std::make_unique<Character>(setup.casters ? "Caster" : "Fighter", 1 + i % 10, world, entity);
+            for (std::size_t m = 0; m < team.moveCount; ++m) {
+                const Ability* ability = registry.find(team.moves[m].ability);
+                if (!character->findAbility(ability->id)) {
+                    character->learnAbility(*ability);
+                }
+            }
+            character->timers = &timers;
+            character->log = log;
+            character->logId = (encounter << 20) | static_cast<std::uint32_t>(characters.size());
+            character->position = Position{static_cast<float>(rng() % 10000) * setup.arenaSize / 10000.0f,
+                                           static_cast<float>(rng() % 10000) * setup.arenaSize / 10000.0f};
+            grids[t].insert(*character);
+            team.members.push_back(character.get());
+            characters.push_back(std::move(character));
+        }
+        largestTeam = std::max(largestTeam, team.members.size());
+    }
+    targets.resize(largestTeam);
+}
+
+// Each living character picks a seeded move, targets through TargetSelection
+// and pays once, however many targets the move hits
+void Simulation::act(Team& team, Character& caster) {
+    const Move& move = team.moves[rng() % team.moveCount];
+    const Ability* ability = caster.findAbility(move.ability);
+    std::size_t count = team.targeting.selectTargets(caster, *ability, move.targetType, targets.data(), targets.size());
+    if (count == 0) {
+        return;
+    }
+    bool used = caster.beginAbility(move.ability) != nullptr;
+    if (caster.log) {
+        for (std::size_t i = 0; i < count; ++i) {
+            caster.log->recordAbility(caster, move.ability, *targets[i], used);
+        }
+    }
+    if (!used) {
+        return;
+    }
+    bool scripted = ability->kind == AbilityKind::Scripted;
+    bool damaging = ability->kind == AbilityKind::Melee || ability->kind == AbilityKind::Spell ||
+                    (scripted && static_cast<const ScriptedAbility*>(ability)->dealsDamage);
+    for (std::size_t i = 0; i < count; ++i) {
+        if (scripted && path == Path::Batch) {
+            scriptedCasts.add(HitRecord{&caster, targets[i], ability});
+        } else if (damaging && path == Path::Batch) {
+            pendingHits.push_back(HitRecord{&caster, targets[i], ability});
+        } else {
+            bool wasAlive = lootEnabled && targets[i]->isAlive();
+            ability->activate(caster, *targets[i]);
+            if (wasAlive && !targets[i]->isAlive()) {
+                loot.recordKill(caster, lootTable);
+            }
+        }
+    }
+    if (damaging) {
+        hits += count;
+    }
+}
+
+void Simulation::wander(Character& character, SpatialGrid& grid) {
+    if (rng() % 8 != 0) {
+        return;
+    }
+    float dx = static_cast<float>(static_cast<int>(rng() % 3) - 1) * 0.5f;
+    float dy = static_cast<float>(static_cast<int>(rng() % 3) - 1) * 0.5f;
+    grid.move(character, Position{character.position.x + dx, character.position.y + dy});
+}
+
+// Dead characters respawn at full health, so every tick does comparable work
+void Simulation::tick() {
+    pendingHits.clear();
+    for (int t = 0; t < 2; ++t) {
+        for (Character* member : teams[t].members) {
+            if (member->isAlive()) {
+                act(teams[t], *member);
+            }
+        }
+    }
+    if (path == Path::Batch) {
+        scriptedCasts.run();
+        pipeline.resolve(pendingHits);
+        if (lootEnabled) {
+            loot.recordKills(scriptedCasts.killingHits(), lootTable);
+            loot.recordKills(pipeline.killingHits(), lootTable);
+        }
+    }
+    for (int t = 0; t < 2; ++t) {
+        for (Character* member : teams[t].members) {
+            if (!member->isAlive()) {
+                ++kills;
+                world.heal(member->entity, world.health.maxHealth[world.slotOf(member->entity)]);
+            }
+            wander(*member, grids[t]);
+        }
+    }
+    world.regenerate(RegenerationRates{2, 2, 1}); // Rage fades while a fighter is out of combat
+    timers.tick();
+}
+
+// There is no inventory in this program, so each recipient's batch is only
+// tallied; a game would hand it to Inventory::add_loot
+void Simulation::distributeLoot() {
+    lootDrops += loot.distribute([this](Character&, const LootDrop* drops, std::size_t count) {
+        ++lootDeliveries;
+        for (std::size_t i = 0; i < count; ++i) {
+            lootCents += drops[i].entry->priceCents * drops[i].quantity;
+        }
+    });
+}
+
+std::uint64_t Simulation::checksum() const {
+    std::uint64_t sum = kills;
+    for (std::size_t slot = 0; slot < world.size(); ++slot) {
+        sum = sum * 1099511628211ull + static_cast<std::uint64_t>(world.health.currentHealth[slot]) * 31u +
+              static_cast<std::uint64_t>(world.mana.currentMana[slot]);
+    }
+    return sum;
+}
+
+struct Options {
+    std::string_view scenario = "all";
+    int ticks = 1000;
+    std::uint32_t seed = 1;
+    Path path = Path::Direct;
+    int encounters = 1; // Independent copies of the scenario, ticked in parallel
+    unsigned threads = 1;
+    std::string trace; // Chrome trace output; needs a GAME_INSTRUMENTATION build to have content
+    std::string log;   // Combat log path prefix; each scenario writes <log>-<scenario>.0, .1, ...
+    std::string abilityScript; // Contents of the --abilities file
+    bool loot = false;
+};
+
+// Runs one scenario and prints a row of the report. Encounters are ticked as
+// tasks on a WorkStealingPool; encounter k uses seed + k, so the checksum
+// doesn't depend on the thread count.
+void runScenario(const Scenario& scenario, const Options& options) {
+    std::unique_ptr<CombatLog> log;
+    if (!options.log.empty()) {
+        log = std::make_unique<CombatLog>(CombatLog::defaultOptions(options.log + "-" + scenario.name));
+    }
+    std::vector<std::unique_ptr<Simulation>> simulations;
+    for (int k = 0; k < options.encounters; ++k) {
+        simulations.push_back(std::make_unique<Simulation>(scenario, options.seed + k, options.path, log.get(),
+                                                           static_cast<std::uint32_t>(k), options.abilityScript,
+                                                           options.loot));
+    }
+    WorkStealingPool pool(options.threads);
+    std::function<void(std::size_t)> tickOne = [&](std::size_t k) { simulations[k]->tick(); };
+    std::function<void(std::size_t)> lootOne = [&](std::size_t k) { simulations[k]->distributeLoot(); };
+
+    // The first ticks grow scratch buffers; keep them out of the numbers
+    int warmup = std::min(10, options.ticks / 10);
+    for (int t = 0; t < warmup; ++t) {
+        if (log) {
+            log->setTick(static_cast<std::uint32_t>(t));
+        }
+        pool.run(simulations.size(), tickOne);
+        if (options.loot) {
+            pool.run(simulations.size(), lootOne);
+        }
+    }
+    std::uint64_t hitsBefore = 0;
+    for (auto& simulation : simulations) {
+        hitsBefore += simulation->hits;
+    }
+
+    int measured = options.ticks - warmup;
+    std::vector<double> latencies;
+    latencies.reserve(measured);
+    double lootMicroseconds = 0.0; // Kept out of the tick latencies
+    std::uint64_t allocationsBefore = allocationCount.load(std::memory_order_relaxed);
+    auto start = std::chrono::steady_clock::now();
+    for (int t = 0; t < measured; ++t) {
+        GAME_SPAN_DETAIL("Simulation::tick", scenario.name);
+        auto tickStart = std::chrono::steady_clock::now();
+        if (log) {
+            log->setTick(static_cast<std::uint32_t>(warmup + t));
+        }
+        pool.run(simulations.size(), tickOne);
+        latencies.push_back(std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - tickStart).count());
+        if (options.loot) {
+            GAME_SPAN_DETAIL("Simulation::distributeLoot", scenario.name);
+            auto lootStart = std::chrono::steady_clock::now();
+            pool.run(simulations.size(), lootOne);
+            lootMicroseconds += std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - lootStart).count();
+        }
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::uint64_t allocations = allocationCount.load(std::memory_order_relaxed) - allocationsBefore;
+
+    std::uint64_t hits = 0;
+    std::uint64_t checksum = 0;
+    for (auto& simulation : simulations) {
+        hits += simulation->hits;
+        checksum = checksum * 31u + simulation->checksum();
+    }
+    hits -= hitsBefore;
+
+    std::sort(latencies.begin(), latencies.end());
+    auto percentile = [&](double p) {
+        return latencies.empty() ? 0.0 : latencies[static_cast<std::size_t>(p * (latencies.size() - 1))];
+    };
+    std::printf("%-6s %-6s %9d %12.0f %10.0f %10.1f %10.1f %12.2f  %016llx\n", scenario.name,
+                options.path == Path::Batch ? "batch" : "direct", measured, seconds > 0 ? hits / seconds : 0.0,
+                seconds > 0 ? measured / seconds : 0.0, percentile(0.50), percentile(0.99),
+                measured > 0 ? static_cast<double>(allocations) / measured : 0.0,
+                static_cast<unsigned long long>(checksum));
+    if (log) {
+        log->flush();
+        CombatLog::Stats stats = log->stats();
+        std::printf("       log: %llu events, %llu dropped, %llu bytes in %llu files\n",
+                    static_cast<unsigned long long>(stats.written), static_cast<unsigned long long>(stats.dropped),
+                    static_cast<unsigned long long>(stats.bytes), static_cast<unsigned long long>(stats.files));
+    }
+    if (options.loot) {
+        std::uint64_t drops = 0;
+        std::uint64_t deliveries = 0;
+        std::int64_t cents = 0;
+        for (auto& simulation : simulations) {
+            drops += simulation->lootDrops;
+            deliveries += simulation->lootDeliveries;
+            cents += simulation->lootCents;
+        }
+        std::printf("       loot: %llu drops in %llu deliveries, worth %lld cents, %.1f us/tick to distribute\n",
+                    static_cast<unsigned long long>(drops), static_cast<unsigned long long>(deliveries),
+                    static_cast<long long>(cents), measured > 0 ? lootMicroseconds / measured : 0.0);
+    }
+}
+
+// --- Self-test (--self-test) ---
+
+// Checks that need no scenario, one line each; returns 1 if any failed
+class SelfTest {
+public:
+    int run() {
+        malformedReplication();
+        staleEntity();
+        abilityNameClash();
+        traceExport();
+        combatLogFile();
+        scriptedKillLoot();
+        timerWheel();
+        scriptCompiler();
+        std::printf("%d failed\n", failures);
+        return failures == 0 ? 0 : 1;
+    }
+
+private:
+    int failures = 0;
+
+    void check(bool passed, const char* what) {
+        std::printf("%-6s %s\n", passed ? "ok" : "FAILED", what);
+        failures += passed ? 0 : 1;
+    }
+
+    // A despawned id whose index has been reused must not touch or reveal the
+    // new entity
+    void staleEntity() {
+        CombatWorld world;
+        EntityId stale = world.spawn(HealthKind::Standard, 500, ManaKind::Arcane, 100);
+        world.despawn(stale);
+        EntityId reused = world.spawn(HealthKind::Standard, 500, ManaKind::Arcane, 100);
+        world.takeDamage(stale, 100);
+        world.heal(stale, 50);
+        world.regenerateMana(stale, -30);
+        bool spent = world.consumeMana(stale, 10);
+        std::size_t slot = world.slotOf(reused);
+        check(!spent && !world.inCombat(stale) && !world.inCombat(reused)
+                  && world.health.currentHealth[slot] == 500 && world.mana.currentMana[slot] == 100,
+              "stale entity ids are ignored");
+
+        Character ghost("Ghost", 1, world, stale);
+        std::vector<Character*> replicated{&ghost};
+        ReplicationEncoder encoder(replicated.size());
+        std::uint8_t message[256];
+        std::size_t size = encoder.encodeSnapshot(replicated, 1, message, sizeof(message));
+        ReplicationDecoder decoder;
+        check(decoder.apply(message, size) && decoder.states().size() == 1 && decoder.states()[0].currentHealth == 0
+                  && decoder.states()[0].maxHealth == 0 && decoder.states()[0].maxMana == 0,
+              "a stale entity replicates as dead");
+    }
+
+    // Two names with the same FNV-1a id: the string API must only use the one
+    // the character has
+    void abilityNameClash() {
+        static_assert(abilityIdOf("Rally77894") == abilityIdOf("Rally1132730"), "names must clash");
+        CombatWorld world;
+        Character fighter("Fighter", 1, world, world.spawn(HealthKind::Standard, 500, ManaKind::Rage, 100));
+        Buff clash("Rally77894", 5);
+        fighter.learnAbility(clash);
+        fighter.useAbility("Rally1132730", fighter);
+        bool wrongUsed = !fighter.activeEffects.empty();
+        fighter.useAbility("Rally77894", fighter);
+        check(!wrongUsed && fighter.activeEffects.size() == 1, "ability names are checked, not just their ids");
+    }
+
+    // Spans name their ability; the trace must still export once the ability
+    // is gone, as it is after runScenario
+    void traceExport() {
+        {
+            CombatWorld world;
+            Character fighter("Fighter", 1, world, world.spawn(HealthKind::Standard, 500, ManaKind::Rage, 100));
+            Buff traced(std::string("Traced ") + "Rally", 5); // Built at run time, so it is on the heap
+            fighter.learnAbility(traced);
+            fighter.useAbility(traced.id, fighter);
+        }
+        char path[] = "/tmp/combat-self-test-XXXXXX";
+        int fd = mkstemp(path);
+        bool written = fd >= 0 && ::close(fd) == 0 && instrumentation::Registry::instance().writeChromeTrace(path);
+        std::ifstream file(path);
+        std::stringstream text;
+        text << file.rdbuf();
+        ::unlink(path);
+        bool named = !instrumentation::enabled || text.str().find("\"detail\":\"Traced Rally\"") != std::string::npos;
+        check(written && text.str().rfind("{\"traceEvents\":[", 0) == 0 && named,
+              "trace exports after its abilities are destroyed");
+    }
+
+    // A kill by a scripted ability drops the same loot whichever path cast it
+    void scriptedKillLoot() {
+        const std::string script = "ability Melee Attack\ndamage 30\n";
+        std::uint64_t drops[2] = {};
+        for (Path path : {Path::Direct, Path::Batch}) {
+            Simulation simulation(scenarios[0], 1, path, nullptr, 0, script, true);
+            for (int tick = 0; tick < 300; ++tick) {
+                simulation.tick();
+                simulation.distributeLoot();
+            }
+            drops[path == Path::Batch] = simulation.lootDrops;
+        }
+        check(drops[0] > 0 && drops[0] == drops[1], "scripted kills drop loot on both paths");
+    }
+
+    // Timers fire on their tick whichever level they start in and however
+    // often they cascade; stale handles and a full wheel schedule or cancel
+    // nothing
+    void timerWheel() {
+        std::vector<std::unique_ptr<Character>> probes;
+        auto event = [&probes](std::size_t probe) {
+            return TimerEvent{TimerEvent::Kind::CooldownReady, nullptr, probes[probe].get()};
+        };
+        const std::uint32_t delays[] = {0, 1, 63, 64, 65, 4095, 4096, 4097, 262143, 262144, 262145, 300000};
+        std::vector<TimerWheel::Tick> due;
+        TimerWheel wheel;
+        for (std::uint32_t delay : delays) {
+            probes.push_back(std::make_unique<Character>("Probe", 1));
+            wheel.schedule(delay, event(probes.size() - 1));
+            due.push_back(delay == 0 ? 1 : delay);
+        }
+        std::vector<TimerWheel::Tick> fired(probes.size(), 0);
+        bool ordered = true;
+        TimerWheel::Tick lastFired = 0;
+        while (wheel.pending() > 0 && wheel.now() < 400000) {
+            if (wheel.now() == 1000) { // Starts away from a level boundary
+                probes.push_back(std::make_unique<Character>("Probe", 1));
+                wheel.schedule(70000, event(probes.size() - 1));
+                due.push_back(71000);
+                fired.push_back(0);
+            }
+            wheel.advance([&](const TimerEvent& fire) {
+                for (std::size_t i = 0; i < probes.size(); ++i) {
+                    if (fire.character == probes[i].get()) {
+                        fired[i] = wheel.now();
+                    }
+                }
+                ordered = ordered && wheel.now() >= lastFired;
+                lastFired = wheel.now();
+            });
+        }
+        check(ordered && fired == due, "timers fire on their tick across every wheel level");
+
+        TimerWheel reuse;
+        TimerId first = reuse.schedule(10, event(0));
+        bool cancelled = reuse.cancel(first);
+        TimerId second = reuse.schedule(10, event(1)); // Same node, next generation
+        bool staleCancelled = reuse.cancel(first);
+        Character* firedFor = nullptr;
+        for (int tick = 0; tick < 10; ++tick) {
+            reuse.advance([&](const TimerEvent& fire) { firedFor = fire.character; });
+        }
+        check(cancelled && !staleCancelled && (second & 0xFFFFFFu) == (first & 0xFFFFFFu) && firedFor == probes[1].get()
+                  && !reuse.cancel(second),
+              "a stale timer handle cancels nothing after its node is reused");
+
+        TimerWheel full(2);
+        TimerId a = full.schedule(1, event(0));
+        full.schedule(1, event(1));
+        TimerId refused = full.schedule(1, event(2));
+        full.cancel(a);
+        check(refused == invalidTimer && full.pending() == 1 && full.schedule(1, event(2)) != invalidTimer,
+              "a full timer wheel refuses new timers");
+    }
+
+    // Constants fold into the instruction before them, bad expressions are
+    // reported by line, and a script written to the native damage formula
+    // deals exactly what SpellCast and MeleeAttack deal
+    void scriptCompiler() {
+        using Op = ScriptedAbility::Op;
+        AbilityRegistry scripted;
+        std::string error;
+        bool loaded = loadAbilityScript("ability Folded\n"
+                                        "damage level * 3 + 4 - 2\n"
+                                        "\n"
+                                        "ability Fireball\n"
+                                        "cost 10\n"
+                                        "damage (20 + 20 * level / 10) * (100 + bonus) / 100\n"
+                                        "\n"
+                                        "ability Melee Attack\n"
+                                        "damage (10 + 10 * level / 10) * (100 + bonus) / 100\n",
+                                        scripted, error);
+        const auto* folded = static_cast<const ScriptedAbility*>(scripted.find(abilityIdOf("Folded")));
+        std::vector<std::pair<Op, std::int32_t>> program;
+        if (folded) {
+            for (const ScriptedAbility::Instruction& instruction : folded->program) {
+                program.emplace_back(instruction.op, instruction.op == Op::Load ? 0 : instruction.operand);
+            }
+        }
+        const std::vector<std::pair<Op, std::int32_t>> expectedProgram = {
+            {Op::Load, 0}, {Op::MultiplyConstant, 3}, {Op::AddConstant, 4}, {Op::AddConstant, -2}, {Op::Damage, 0}};
+        check(loaded && program == expectedProgram, "script constants fold into the instruction before them");
+
+        std::string nested = "damage level";
+        for (std::size_t i = 0; i <= ScriptedAbility::maxStackDepth; ++i) {
+            nested += " + (level";
+        }
+        nested += std::string(ScriptedAbility::maxStackDepth + 1, ')');
+        AbilityRegistry rejected;
+        bool tooDeep = !loadAbilityScript("ability Deep\n" + nested + "\n", rejected, error)
+                       && error == "line 2: expression nests too deeply";
+        bool unexpected = !loadAbilityScript("ability Stray\ndamage 1 2\n", rejected, error)
+                          && error == "line 2: unexpected '2'";
+        check(tooDeep && unexpected && rejected.size() == 0, "script expression errors are reported by line");
+
+        DamageCalculator calculator;
+        AbilityRegistry native;
+        native.add(std::make_unique<SpellCast>("Fireball", &calculator, nullptr));
+        native.add(std::make_unique<MeleeAttack>(10, &calculator, nullptr));
+        Buff rally("Rally", 0);
+        Debuff curse("Curse", 0);
+        CombatWorld world;
+        auto spawn = [&world](const char* name, int level, HealthKind kind) {
+            return std::make_unique<Character>(name, level, world, world.spawn(kind, 100000, ManaKind::Arcane, 1000));
+        };
+        bool same = true;
+        for (AbilityId id : {abilityIdOf("Fireball"), meleeAttackId}) {
+            for (int level = 1; level <= 10; level += 3) {
+                for (int variant = 0; variant < 4; ++variant) {
+                    HealthKind kind = variant & 1 ? HealthKind::Armored : HealthKind::Standard;
+                    auto caster = spawn("Caster", level, HealthKind::Standard);
+                    auto nativeTarget = spawn("Target", 1, kind);
+                    auto scriptedTarget = spawn("Target", 1, kind);
+                    if (variant & 2) {
+                        rally.apply(*caster);
+                        curse.apply(*nativeTarget);
+                        curse.apply(*scriptedTarget);
+                    }
+                    native.find(id)->activate(*caster, *nativeTarget);
+                    scripted.find(id)->activate(*caster, *scriptedTarget);
+                    int nativeHealth = world.health.currentHealth[world.slotOf(nativeTarget->entity)];
+                    int scriptedHealth = world.health.currentHealth[world.slotOf(scriptedTarget->entity)];
+                    same = same && nativeHealth < 100000 && nativeHealth == scriptedHealth;
+                }
+            }
+        }
+        check(same && scripted.find(abilityIdOf("Fireball"))->resourceCost == native.find(abilityIdOf("Fireball"))->resourceCost,
+              "scripted damage matches the native SpellCast and MeleeAttack");
+    }
+
+    static bool readBytes(const std::string& path, std::string& bytes) {
+        std::ifstream file(path, std::ios::binary);
+        std::stringstream text;
+        text << file.rdbuf();
+        bytes = text.str();
+        return static_cast<bool>(file);
+    }
+
+    static void writeBytes(const std::string& path, const std::string& bytes) {
+        std::ofstream(path, std::ios::binary | std::ios::trunc) << bytes;
+    }
+
+    // Log files read back as recorded; a truncated file or a forged event
+    // count is rejected without reading past the data
+    void combatLogFile() {
+        char directory[] = "/tmp/combat-self-test-XXXXXX";
+        if (mkdtemp(directory) == nullptr) {
+            check(false, "combat log scratch directory");
+            return;
+        }
+        std::string prefix = std::string(directory) + "/combat";
+        std::vector<CombatEvent> expected;
+        {
+            CombatLog::Options options = CombatLog::defaultOptions(prefix);
+            options.blockEvents = 32; // Several blocks in one file
+            CombatLog log(options);
+            for (std::uint32_t i = 0; i < 100; ++i) {
+                log.setTick(i / 7);
+                CombatEvent event{0, i % 5, (i * 3) % 5, i % 2 ? meleeAttackId : rallyId,
+                                  static_cast<std::int32_t>(i) - 40, static_cast<std::int32_t>(i % 3),
+                                  static_cast<CombatEvent::Kind>(i % 4), 0};
+                log.record(event);
+                event.tick = i / 7;
+                expected.push_back(event);
+            }
+        }
+        std::string path = prefix + ".0";
+        std::vector<CombatEvent> events;
+        bool same = CombatLog::readFile(path, events) && events.size() == expected.size();
+        for (std::size_t i = 0; same && i < events.size(); ++i) {
+            const CombatEvent& a = events[i];
+            const CombatEvent& b = expected[i];
+            same = a.tick == b.tick && a.actor == b.actor && a.target == b.target && a.ability == b.ability
+                   && a.amount == b.amount && a.result == b.result && a.kind == b.kind && a.thread == b.thread;
+        }
+        check(same, "combat log file reads back as recorded");
+
+        std::string image;
+        readBytes(path, image);
+        bool truncatedRejected = true;
+        for (std::size_t cut : {std::size_t{1}, std::size_t{9}, image.size() / 2}) {
+            writeBytes(path, image.substr(0, image.size() - cut));
+            events.clear();
+            truncatedRejected = truncatedRejected && !CombatLog::readFile(path, events);
+        }
+        check(truncatedRejected, "truncated combat log file is rejected");
+
+        std::string forged = image;
+        std::uint32_t count = 0xFFFFFFFFu;
+        std::memcpy(&forged[8], &count, sizeof(count)); // First block's event count, after the file header
+        writeBytes(path, forged);
+        events.clear();
+        check(!CombatLog::readFile(path, events) && events.size() <= expected.size(),
+              "forged combat log event count is rejected");
+        ::unlink(path.c_str());
+        ::rmdir(directory);
+    }
+
+    // Garbage from the wire must come back false, never as an exception or
+    // an allocation sized by a forged count
+    void malformedReplication() {
+        AbilityRegistry registry;
+        registry.add(std::make_unique<Buff>("Rally", 5));
+        CombatWorld world;
+        std::vector<std::unique_ptr<Character>> owned;
+        std::vector<Character*> characters;
+        for (int i = 0; i < 16; ++i) {
+            owned.push_back(std::make_unique<Character>("Fighter", 1 + i % 10, world,
+                                                        world.spawn(HealthKind::Standard, 500, ManaKind::Rage, 100)));
+            owned.back()->learnAbility(*registry.find(rallyId));
+            characters.push_back(owned.back().get());
+        }
+        for (int i = 0; i < 16; i += 3) {
+            characters[i]->useAbility(rallyId, *characters[i]);
+            characters[i]->takeDamage(40 + i);
+        }
+
+        ReplicationEncoder encoder(characters.size());
+        std::uint8_t snapshot[4096];
+        std::size_t snapshotSize = encoder.encodeSnapshot(characters, 1, snapshot, sizeof(snapshot));
+        ReplicationDecoder decoder;
+        check(snapshotSize > 0 && decoder.apply(snapshot, snapshotSize) && decoder.states().size() == characters.size(),
+              "replication snapshot round-trips");
+
+        std::uint8_t forged[16];
+        BitWriter writer(forged, sizeof(forged));
+        writer.write(0, 1);
+        writer.write(2, 32);
+        writer.writeVarUint(0xFFFFFFFFu); // Snapshot claiming four billion records
+        std::size_t forgedSize = writer.finish();
+        std::uint64_t allocationsBefore = allocationCount.load(std::memory_order_relaxed);
+        bool accepted = decoder.apply(forged, forgedSize);
+        check(!accepted && allocationCount.load(std::memory_order_relaxed) == allocationsBefore,
+              "forged record count is rejected before allocating");
+
+        for (int i = 1; i < 16; i += 4) {
+            characters[i]->takeDamage(25);
+        }
+        std::uint8_t delta[4096];
+        std::size_t deltaSize = encoder.encodeDelta(characters, 2, delta, sizeof(delta));
+        ReplicationDecoder baseline;
+        baseline.apply(snapshot, snapshotSize);
+
+        // Flipped bits, truncations and random bytes in place of the snapshot
+        // or the delta after it. A message may only grow the state by what
+        // its own bits could encode.
+        std::mt19937 rng(7);
+        std::uint8_t message[sizeof(snapshot)];
+        bool bounded = deltaSize > 0;
+        for (int round = 0; round < 20000; ++round) {
+            bool mutateDelta = round % 2 != 0;
+            std::size_t size = mutateDelta ? deltaSize : snapshotSize;
+            std::memcpy(message, mutateDelta ? delta : snapshot, size);
+            switch (round / 2 % 3) {
+            case 0:
+                for (int flips = 1 + static_cast<int>(rng() % 4); flips > 0; --flips) {
+                    message[rng() % size] ^= static_cast<std::uint8_t>(1u << (rng() % 8));
+                }
+                break;
+            case 1:
+                size = rng() % size;
+                break;
+            default:
+                size = 1 + rng() % size;
+                for (std::size_t i = 0; i < size; ++i) {
+                    message[i] = static_cast<std::uint8_t>(rng());
+                }
+                break;
+            }
+            ReplicationDecoder fuzzed = baseline;
+            try {
+                fuzzed.apply(message, size);
+            } catch (...) {
+                bounded = false;
+            }
+            bounded = bounded && fuzzed.states().size() <= std::max(characters.size(), size * 8 / 30);
+        }
+        check(bounded, "random and corrupted messages are rejected or decoded within their size");
+    }
+};
+
+void printUsage() {
+    std::printf("usage: combat_sim [--scenario 1v1|raid|aoe|all] [--ticks N] [--seed S]\n"
+                "                  [--path direct|batch] [--encounters K] [--threads T] [--trace FILE]\n"
+                "                  [--log PREFIX] [--abilities FILE] [--loot]\n"
+                "       combat_sim --self-test\n");
+}
+
+}
+
+int main(int argc, char *argv[]) {
+    Options options;
+    for (int i = 1; i < argc; ++i) {
+        std::string_view arg = argv[i];
+        if (arg == "--scenario" && i + 1 < argc) {
+            options.scenario = argv[++i];
+        } else if (arg == "--ticks" && i + 1 < argc) {
+            options.ticks = std::max(1, static_cast<int>(std::strtoul(argv[++i], nullptr, 10)));
+        } else if (arg == "--seed" && i + 1 < argc) {
+            options.seed = static_cast<std::uint32_t>(std::strtoul(argv[++i], nullptr, 10));
+        } else if (arg == "--path" && i + 1 < argc) {
+            options.path = std::string_view(argv[++i]) == "batch" ? Path::Batch : Path::Direct;
+        } else if (arg == "--encounters" && i + 1 < argc) {
+            options.encounters = std::max(1, static_cast<int>(std::strtoul(argv[++i], nullptr, 10)));
+        } else if (arg == "--threads" && i + 1 < argc) {
+            options.threads = static_cast<unsigned>(std::strtoul(argv[++i], nullptr, 10));
+        } else if (arg == "--trace" && i + 1 < argc) {
+            options.trace = argv[++i];
+        } else if (arg == "--log" && i + 1 < argc) {
+            options.log = argv[++i];
+        } else if (arg == "--self-test") {
+            return SelfTest().run();
+        } else if (arg == "--loot") {
+            options.loot = true;
+        } else if (arg == "--abilities" && i + 1 < argc) {
+            std::ifstream file(argv[++i]);
+            if (!file) {
+                std::printf("could not read %s\n", argv[i]);
+                return 1;
+            }
+            std::ostringstream contents;
+            contents << file.rdbuf();
+            options.abilityScript = contents.str();
+            AbilityRegistry check;
+            std::string error;
+            if (!loadAbilityScript(options.abilityScript, check, error)) {
+                std::printf("%s: %s\n", argv[i], error.c_str());
+                return 1;
+            }
+        } else {
+            printUsage();
+            return arg == "--help" ? 0 : 1;
+        }
+    }
+
+    std::printf("%-6s %-6s %9s %12s %10s %10s %10s %12s  %s\n", "scene", "path", "ticks", "hits/s", "ticks/s",
+                "p50(us)", "p99(us)", "allocs/tick", "checksum");
+    bool ran = false;
+    for (const Scenario& scenario : scenarios) {
+        if (options.scenario == "all" || options.scenario == scenario.name) {
+            runScenario(scenario, options);
+            ran = true;
+        }
+    }
+    if (!ran) {
+        printUsage();
+        return 1;
+    }
+    if (!options.trace.empty() && !instrumentation::Registry::instance().writeChromeTrace(options.trace)) {
+        std::printf("could not write trace to %s\n", options.trace.c_str());
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,262 @@
+// instrumentation.h
+// Per-thread counters and scoped timing spans for the combat and inventory
+// hot paths, exported as a Chrome trace (chrome://tracing or Perfetto).
+//
+// Build with -DGAME_INSTRUMENTATION to record. Without it GAME_SPAN,
+// GAME_SPAN_DETAIL and GAME_COUNT expand to nothing, so instrumented code
+// compiles to exactly what it was; the Registry still exists (unused) so
+// export calls need no #if.
+#ifndef GAME_INSTRUMENTATION_H
+#define GAME_INSTRUMENTATION_H
+
+#include <atomic> // For counters read while threads record
+#include <chrono> // For TSC calibration and the non-x86 clock
+#include <cstdint> // For fixed-width ticks
+#include <cstdio> // For writing the trace
+#include <memory> // For std::unique_ptr
+#include <mutex> // For registration
+#include <string> // For paths
+#include <unordered_set> // For interned span details
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h> // For __rdtsc
+#endif
+
+namespace instrumentation {
+
+#if defined(GAME_INSTRUMENTATION)
+constexpr bool enabled = true;
+#else
+constexpr bool enabled = false;
+#endif
+
+using CounterId = std::uint32_t;
+constexpr std::size_t maxCounters = 256;
+constexpr std::size_t spansPerThread = std::size_t{1} << 15; // Ring; the newest spans are kept
+
+// Raw timestamp: the TSC on x86, nanoseconds elsewhere
+inline std::uint64_t now() {
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return static_cast<std::uint64_t>(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count());
+#endif
+}
+
+// name and detail must outlive the export: string literals, interned item
+// names, or text from internDetail()
+struct SpanRecord {
+    const char* name;
+    const char* detail;
+    std::uint64_t start;
+    std::uint64_t end;
+};
+
+// Everything one thread records. Only the owning thread writes; counters are
+// relaxed atomics so they can be summed while it runs.
+struct ThreadData {
+    std::uint32_t threadIndex;
+    std::atomic<std::uint64_t> counters[maxCounters] = {};
+    std::vector<SpanRecord> spans = std::vector<SpanRecord>(spansPerThread);
+    std::uint64_t spanCount = 0; // Total recorded; the ring holds the last spansPerThread
+
+    void add(CounterId id, std::uint64_t amount) {
+        counters[id].store(counters[id].load(std::memory_order_relaxed) + amount, std::memory_order_relaxed);
+    }
+
+    void record(const char* name, const char* detail, std::uint64_t start, std::uint64_t end) {
+        spans[spanCount++ & (spansPerThread - 1)] = SpanRecord{name, detail, start, end};
+    }
+};
+
+class Registry {
+public:
+    static Registry& instance() {
+        static Registry registry;
+        return registry;
+    }
+
+    // Same label, same id; labels beyond maxCounters share the last id
+    CounterId registerCounter(const char* label) {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (std::size_t i = 0; i < counterLabels.size(); ++i) {
+            if (std::string(counterLabels[i]) == label) {
+                return static_cast<CounterId>(i);
+            }
+        }
+        if (counterLabels.size() == maxCounters) {
+            return static_cast<CounterId>(maxCounters - 1);
+        }
+        counterLabels.push_back(label);
+        return static_cast<CounterId>(counterLabels.size() - 1);
+    }
+
+    // The calling thread's buffers, created on first use and kept after the
+    // thread exits so its spans still export
+    ThreadData& threadData() {
+        thread_local ThreadData* data = nullptr;
+        if (!data) {
+            auto created = std::make_unique<ThreadData>();
+            std::lock_guard<std::mutex> lock(mutex);
+            created->threadIndex = static_cast<std::uint32_t>(threads.size());
+            data = created.get();
+            threads.push_back(std::move(created));
+        }
+        return *data;
+    }
+
+    // Sum over every thread
+    std::uint64_t counterTotal(const char* label) {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (std::size_t i = 0; i < counterLabels.size(); ++i) {
+            if (std::string(counterLabels[i]) == label) {
+                return totalLocked(i);
+            }
+        }
+        return 0;
+    }
+
+    // A copy of text that lives as long as the registry; the same text always
+    // gets the same pointer
+    const char* intern(const char* text) {
+        std::lock_guard<std::mutex> lock(mutex);
+        return interned.emplace(text).first->c_str();
+    }
+
+    // Spans as complete ("X") events per thread, then every counter's total as
+    // one counter ("C") event. Call while no thread is recording.
+    bool writeChromeTrace(const std::string& path) {
+        std::FILE* file = std::fopen(path.c_str(), "w");
+        if (!file) {
+            return false;
+        }
+        std::lock_guard<std::mutex> lock(mutex);
+        double ticksPerMicrosecond = calibrate();
+        std::fputs("{\"traceEvents\":[\n", file);
+        bool first = true;
+        std::uint64_t last = epochTicks;
+        for (const auto& thread : threads) {
+            std::uint64_t count = thread->spanCount < spansPerThread ? thread->spanCount : spansPerThread;
+            for (std::uint64_t i = thread->spanCount - count; i < thread->spanCount; ++i) {
+                const SpanRecord& span = thread->spans[i & (spansPerThread - 1)];
+                std::fputs(first ? "" : ",\n", file);
+                first = false;
+                std::fputs("{\"name\":", file);
+                writeString(file, span.name);
+                std::fprintf(file, ",\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f", thread->threadIndex,
+                             static_cast<double>(span.start - epochTicks) / ticksPerMicrosecond,
+                             static_cast<double>(span.end - span.start) / ticksPerMicrosecond);
+                if (span.detail) {
+                    std::fputs(",\"args\":{\"detail\":", file);
+                    writeString(file, span.detail);
+                    std::fputc('}', file);
+                }
+                std::fputc('}', file);
+                last = span.end > last ? span.end : last;
+            }
+        }
+        for (std::size_t i = 0; i < counterLabels.size(); ++i) {
+            std::fputs(first ? "" : ",\n", file);
+            first = false;
+            std::fputs("{\"name\":", file);
+            writeString(file, counterLabels[i]);
+            std::fprintf(file, ",\"ph\":\"C\",\"pid\":1,\"ts\":%.3f,\"args\":{\"value\":%llu}}",
+                         static_cast<double>(last - epochTicks) / ticksPerMicrosecond,
+                         static_cast<unsigned long long>(totalLocked(i)));
+        }
+        std::fputs("\n]}\n", file);
+        return std::fclose(file) == 0;
+    }
+
+private:
+    std::mutex mutex;
+    std::vector<const char*> counterLabels;
+    std::vector<std::unique_ptr<ThreadData>> threads;
+    std::unordered_set<std::string> interned; // Nodes never move, so c_str() stays valid
+    std::uint64_t epochTicks = now();
+    std::chrono::steady_clock::time_point epochTime = std::chrono::steady_clock::now();
+
+    std::uint64_t totalLocked(std::size_t id) const {
+        std::uint64_t total = 0;
+        for (const auto& thread : threads) {
+            total += thread->counters[id].load(std::memory_order_relaxed);
+        }
+        return total;
+    }
+
+    // Raw ticks per microsecond, measured against steady_clock since startup
+    double calibrate() const {
+        double elapsed = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - epochTime).count();
+        std::uint64_t ticks = now() - epochTicks;
+        return elapsed > 0.0 && ticks > 0 ? static_cast<double>(ticks) / elapsed : 1000.0;
+    }
+
+    static void writeString(std::FILE* file, const char* text) {
+        std::fputc('"', file);
+        for (const char* c = text; *c; ++c) {
+            unsigned char ch = static_cast<unsigned char>(*c);
+            if (ch == '"' || ch == '\\') {
+                std::fputc('\\', file);
+                std::fputc(ch, file);
+            } else if (ch < 0x20) {
+                std::fprintf(file, "\\u%04x", ch);
+            } else {
+                std::fputc(ch, file);
+            }
+        }
+        std::fputc('"', file);
+    }
+};
+
+// Span detail text that outlives whatever it was copied from, e.g. the name
+// of an ability that is destroyed before the export. Interns once per call,
+// so call it when the owner is created, not per span. nullptr (no detail)
+// when instrumentation is compiled out.
+inline const char* internDetail(const char* text) {
+    return enabled ? Registry::instance().intern(text) : nullptr;
+}
+
+inline void add(CounterId id, std::uint64_t amount) {
+    Registry::instance().threadData().add(id, amount);
+}
+
+// Records [construction, destruction) as one span on the current thread
+class ScopedSpan {
+public:
+    ScopedSpan(const char* name, const char* detail) : name(name), detail(detail), start(now()) {}
+    ~ScopedSpan() { Registry::instance().threadData().record(name, detail, start, now()); }
+
+    ScopedSpan(const ScopedSpan&) = delete;
+    ScopedSpan& operator=(const ScopedSpan&) = delete;
+
+private:
+    const char* name;
+    const char* detail;
+    std::uint64_t start;
+};
+
+}
+
+#define GAME_INSTRUMENTATION_CONCAT_INNER(a, b) a##b
+#define GAME_INSTRUMENTATION_CONCAT(a, b) GAME_INSTRUMENTATION_CONCAT_INNER(a, b)
+
+#if defined(GAME_INSTRUMENTATION)
+#define GAME_SPAN(name) \
+    ::instrumentation::ScopedSpan GAME_INSTRUMENTATION_CONCAT(gameSpan, __LINE__)(name, nullptr)
+#define GAME_SPAN_DETAIL(name, detail) \
+    ::instrumentation::ScopedSpan GAME_INSTRUMENTATION_CONCAT(gameSpan, __LINE__)(name, detail)
+#define GAME_COUNT(label, amount)                                                                   \
+    do {                                                                                            \
+        static const ::instrumentation::CounterId gameCounterId =                                   \
+            ::instrumentation::Registry::instance().registerCounter(label);                         \
+        ::instrumentation::add(gameCounterId, static_cast<std::uint64_t>(amount));                  \
+    } while (0)
+#else
+#define GAME_SPAN(name) ((void)0)
+#define GAME_SPAN_DETAIL(name, detail) ((void)0)
+#define GAME_COUNT(label, amount) ((void)0)
+#endif
+
+#endif // GAME_INSTRUMENTATION_H
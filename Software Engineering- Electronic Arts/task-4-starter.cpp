@@ -3,84 +3,1664 @@
 #include <utility> // For std::move
 #include <vector>  // For std::vector
 #include <memory>  // For std::unique_ptr
+#include <memory_resource> // For std::pmr pools behind the item stores
+#include <new>     // For placement new of pooled Items
 #include <limits>  // For std::numeric_limits, used with std::cin.ignore
 #include <algorithm> // For std::find_if, or std::remove_if if used
+#include <cstddef>  // For std::size_t
+#include <functional> // For std::hash
+#include <string_view> // For lookups without temporary strings
+#include <charconv> // For std::to_chars in the buffered listing
+#include <cstdint>  // For std::int64_t money amounts
+#include <ostream>  // For printing Money
+#include <atomic>   // For ConcurrentInventory's revenue counters
+#include <mutex>    // For ConcurrentInventory's shard locks
+#include <stdexcept> // For std::length_error when NameTable is full
+#include <thread>   // For std::thread::hardware_concurrency
+#include <condition_variable> // For TransactionLog group commit
+#include <cstring>  // For std::memcpy / std::memcmp in snapshots
+#include <cstdio>   // For std::rename
+#include <fcntl.h>    // POSIX open, used for snapshots
+#include <sys/mman.h> // POSIX mmap, used for snapshots
+#include <sys/stat.h> // POSIX fstat
+#include <unistd.h>   // POSIX write / fsync / close
+#include <malloc.h>   // glibc mallinfo2, for the benchmark's memory figures
+#include <chrono>     // For benchmark timing
+#include <cmath>      // For the Zipf sampler
+#include <random>     // For benchmark workloads
+#include <cstdlib>    // For std::strtoull
+
+#include "Instrumentation.h" // GAME_SPAN / GAME_COUNT, compiled out unless GAME_INSTRUMENTATION is defined
+#include "Class Definition.h" // LootEntry / LootDrop for add_loot; header-only use, so no need to link the combat system
+
+// Exact money amount stored as an integer number of cents, so sales can be
+// accumulated indefinitely without the drift of float arithmetic. Sums and
+// products saturate at the int64 limits instead of overflowing.
+class Money {
+private:
+    std::int64_t cents;
+
+    explicit constexpr Money(std::int64_t cents) :
+        cents{cents} {
+    }
+
+    static constexpr std::int64_t saturated(bool negative) {
+        return negative ? std::numeric_limits<std::int64_t>::min() : std::numeric_limits<std::int64_t>::max();
+    }
+
+    static std::int64_t add_cents(std::int64_t a, std::int64_t b) {
+        std::int64_t sum;
+        return __builtin_add_overflow(a, b, &sum) ? saturated(a < 0) : sum;
+    }
+
+public:
+    constexpr Money() :
+        cents{0} {
+    }
+
+    static constexpr Money from_cents(std::int64_t cents) {
+        return Money{cents};
+    }
+
+    constexpr std::int64_t get_cents() const {
+        return cents;
+    }
+
+    // Parses a non-negative decimal amount with at most two fractional
+    // digits ("12", "12.5", "12.34"), up to the largest whole amount whose
+    // cents fit. Returns false on anything else.
+    static bool parse(std::string_view text, Money &out) {
+        std::size_t dot = text.find('.');
+        std::string_view whole = text.substr(0, dot);
+        std::string_view fraction = dot == std::string_view::npos ? std::string_view{} : text.substr(dot + 1);
+        if ((whole.empty() && fraction.empty()) || fraction.size() > 2) {
+            return false;
+        }
+
+        std::int64_t units = 0;
+        if (!whole.empty()) {
+            auto result = std::from_chars(whole.data(), whole.data() + whole.size(), units);
+            if (result.ec != std::errc{} || result.ptr != whole.data() + whole.size() || whole[0] == '-'
+                || units > (std::numeric_limits<std::int64_t>::max() - 99) / 100) {
+                return false;
+            }
+        }
+        std::int64_t fraction_cents = 0;
+        for (std::size_t i = 0; i < 2; ++i) {
+            char digit = i < fraction.size() ? fraction[i] : '0';
+            if (digit < '0' || digit > '9') {
+                return false;
+            }
+            fraction_cents = fraction_cents * 10 + (digit - '0');
+        }
+        out = Money{units * 100 + fraction_cents};
+        return true;
+    }
+
+    // Appends the amount as "units.cc"
+    void append_to(std::string &out) const {
+        std::int64_t magnitude = cents < 0 ? -cents : cents;
+        if (cents < 0) {
+            out += '-';
+        }
+        char digits[24];
+        auto result = std::to_chars(digits, digits + sizeof(digits), magnitude / 100);
+        out.append(digits, result.ptr);
+        out += '.';
+        out += static_cast<char>('0' + magnitude % 100 / 10);
+        out += static_cast<char>('0' + magnitude % 10);
+    }
+
+    Money &operator+=(Money other) {
+        cents = add_cents(cents, other.cents);
+        return *this;
+    }
+
+    friend Money operator+(Money a, Money b) {
+        return Money{add_cents(a.cents, b.cents)};
+    }
+
+    friend Money operator*(Money price, int quantity) {
+        std::int64_t product;
+        if (__builtin_mul_overflow(price.cents, std::int64_t{quantity}, &product)) {
+            product = saturated((price.cents < 0) != (quantity < 0));
+        }
+        return Money{product};
+    }
+
+    friend bool operator==(Money a, Money b) {
+        return a.cents == b.cents;
+    }
+
+    friend bool operator!=(Money a, Money b) {
+        return a.cents != b.cents;
+    }
+
+    friend bool operator<(Money a, Money b) {
+        return a.cents < b.cents;
+    }
+
+    friend std::ostream &operator<<(std::ostream &os, Money amount) {
+        std::string text;
+        amount.append_to(text);
+        return os << text;
+    }
+};
+
+// Sum of quantities[i] * cents[i] over contiguous arrays: stock times unit
+// price gives inventory value, units sold times unit price gives revenue.
+// Four independent accumulators and no branches let the compiler vectorize
+// the loop; integer math keeps the result exact. The math is unsigned so a
+// total too large for int64 wraps rather than being undefined.
+inline std::int64_t sum_of_products(const int *quantities, const std::int64_t *cents, std::size_t count) {
+    std::uint64_t acc0 = 0, acc1 = 0, acc2 = 0, acc3 = 0;
+    std::size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        acc0 += static_cast<std::uint64_t>(quantities[i]) * static_cast<std::uint64_t>(cents[i]);
+        acc1 += static_cast<std::uint64_t>(quantities[i + 1]) * static_cast<std::uint64_t>(cents[i + 1]);
+        acc2 += static_cast<std::uint64_t>(quantities[i + 2]) * static_cast<std::uint64_t>(cents[i + 2]);
+        acc3 += static_cast<std::uint64_t>(quantities[i + 3]) * static_cast<std::uint64_t>(cents[i + 3]);
+    }
+    for (; i < count; ++i) {
+        acc0 += static_cast<std::uint64_t>(quantities[i]) * static_cast<std::uint64_t>(cents[i]);
+    }
+    return static_cast<std::int64_t>((acc0 + acc1) + (acc2 + acc3));
+}
+
+// Flat open-addressing hash index from an item name to its slot in the owning
+// container. Only the name's hash and the slot are stored; candidate names are
+// read back through the caller's predicate, so lookups work on a
+// std::string_view and never build a temporary std::string.
+class NameIndex {
+public:
+    static constexpr std::size_t npos = static_cast<std::size_t>(-1);
+
+    static std::size_t hash(std::string_view name) {
+        return std::hash<std::string_view>{}(name);
+    }
+
+    // Returns the slot of the first entry with this hash that satisfies
+    // matches(slot), or npos if there is none.
+    template <typename Matches>
+    std::size_t find(std::size_t name_hash, Matches matches) const {
+        if (entries.empty()) {
+            return npos;
+        }
+        for (std::size_t i = name_hash & mask;; i = (i + 1) & mask) {
+            const Entry &entry = entries[i];
+            if (entry.slot == npos) {
+                return npos;
+            }
+            if (entry.hash == name_hash && matches(entry.slot)) {
+                return entry.slot;
+            }
+        }
+    }
+
+    // The caller guarantees the name is not already indexed.
+    void insert(std::size_t name_hash, std::size_t slot) {
+        if ((count + 1) * 4 > entries.size() * 3) {
+            grow();
+        }
+        place(Entry{name_hash, slot});
+        ++count;
+    }
+
+    void erase(std::size_t name_hash, std::size_t slot) {
+        std::size_t hole = locate(name_hash, slot);
+        // Backward-shift deletion keeps probe chains intact without tombstones
+        for (std::size_t next = (hole + 1) & mask; entries[next].slot != npos; next = (next + 1) & mask) {
+            std::size_t home = entries[next].hash & mask;
+            bool movable = hole <= next ? (home <= hole || home > next)
+                                        : (home <= hole && home > next);
+            if (movable) {
+                entries[hole] = entries[next];
+                hole = next;
+            }
+        }
+        entries[hole].slot = npos;
+        --count;
+    }
+
+    // Points an existing entry at a new slot after its item moved in the container
+    void relocate(std::size_t name_hash, std::size_t from, std::size_t to) {
+        entries[locate(name_hash, from)].slot = to;
+    }
+
+    void clear() {
+        entries.clear();
+        mask = 0;
+        count = 0;
+    }
+
+    // Sizes the table for item_count entries up front, e.g. for bulk loads
+    void reserve(std::size_t item_count) {
+        std::size_t capacity = entries.empty() ? 16 : entries.size();
+        while (item_count * 4 > capacity * 3) {
+            capacity *= 2;
+        }
+        if (capacity > entries.size()) {
+            rehash(capacity);
+        }
+    }
+
+private:
+    struct Entry {
+        std::size_t hash;
+        std::size_t slot;
+    };
+
+    std::vector<Entry> entries;
+    std::size_t mask = 0;
+    std::size_t count = 0;
+
+    std::size_t locate(std::size_t name_hash, std::size_t slot) const {
+        std::size_t i = name_hash & mask;
+        while (entries[i].slot != slot) {
+            i = (i + 1) & mask;
+        }
+        return i;
+    }
+
+    void place(Entry entry) {
+        std::size_t i = entry.hash & mask;
+        while (entries[i].slot != npos) {
+            i = (i + 1) & mask;
+        }
+        entries[i] = entry;
+    }
+
+    void grow() {
+        rehash(entries.empty() ? 16 : entries.size() * 2);
+    }
+
+    // capacity must be a power of two
+    void rehash(std::size_t capacity) {
+        std::vector<Entry> old = std::move(entries);
+        entries.assign(capacity, Entry{0, npos});
+        mask = capacity - 1;
+        for (const Entry &entry : old) {
+            if (entry.slot != npos) {
+                place(entry);
+            }
+        }
+    }
+};
+
+using NameId = std::uint32_t;
+
+// Process-wide table of interned item names. Each distinct name is stored
+// once and identified by a dense NameId, so items across every inventory hold
+// a 4-byte handle and compare names with a single integer compare.
+//
+// Interning and lookup are thread-safe, and lookups take no lock, so threads
+// on different ConcurrentInventory shards don't meet on a shared lock word.
+// Entries live in fixed-size chunks that never move, and the hash index is
+// published as whole tables: the writer fills a bigger table before swapping
+// it in with a release store, and only adds to the current one. Names are
+// never removed, which suits SKU catalogues whose names keep coming back,
+// and lets a lookup that races an intern simply miss the new name.
+class NameTable {
+public:
+    static constexpr NameId invalid_id = static_cast<NameId>(-1);
+
+    static NameTable &shared() {
+        static NameTable table;
+        return table;
+    }
+
+    NameTable() = default;
+    NameTable(const NameTable &) = delete;
+    NameTable &operator=(const NameTable &) = delete;
+
+    ~NameTable() {
+        for (auto &chunk : chunks) {
+            delete[] chunk.load(std::memory_order_relaxed);
+        }
+    }
+
+    // Returns the id for name, adding it on first use. Throws
+    // std::length_error once the table holds max_names names.
+    NameId intern(std::string_view name) {
+        std::size_t name_hash = NameIndex::hash(name);
+        NameId id = find_published(name, name_hash);
+        if (id != invalid_id) {
+            return id;
+        }
+        std::lock_guard<std::mutex> guard(write_lock);
+        return intern_locked(name, name_hash); // Another thread may have won the race
+    }
+
+    // Interns count names under one lock, writing name(i)'s id to ids[i];
+    // for bulk loads such as snapshots
+    template <typename Names>
+    void intern_all(std::size_t count, Names name, NameId *ids) {
+        std::lock_guard<std::mutex> guard(write_lock);
+        for (std::size_t i = 0; i < count; ++i) {
+            std::string_view text = name(i);
+            ids[i] = intern_locked(text, NameIndex::hash(text));
+        }
+    }
+
+    // Returns invalid_id if name was never interned
+    NameId find(std::string_view name) const {
+        return find_published(name, NameIndex::hash(name));
+    }
+
+    // id must have come from intern() or a successful find()
+    const std::string &get_name(NameId id) const {
+        return entry(id).name;
+    }
+
+    // The NameIndex::hash of the name, computed once at intern time
+    std::size_t get_hash(NameId id) const {
+        return entry(id).hash;
+    }
+
+private:
+    struct Entry {
+        std::string name;
+        std::size_t hash;
+    };
+
+    // Open addressing over words of (upper hash bits << 32 | id + 1); 0 is empty
+    struct Slots {
+        std::size_t mask;
+        std::unique_ptr<std::atomic<std::uint64_t>[]> words;
+    };
+
+    static constexpr std::size_t chunk_bits = 12;
+    static constexpr std::size_t chunk_size = std::size_t{1} << chunk_bits;
+    static constexpr std::size_t chunk_mask = chunk_size - 1;
+    static constexpr std::size_t max_chunks = 65536;
+    static constexpr std::size_t max_names = max_chunks * chunk_size; // 256M
+
+    std::mutex write_lock; // Serialises interning
+    NameId count = 0;      // Written under write_lock only
+    std::atomic<Entry *> chunks[max_chunks] = {};
+    std::atomic<const Slots *> slots{nullptr};
+    // The current table and every one it replaced, kept because a reader may
+    // still be probing an old one; together under twice the current size
+    std::vector<std::unique_ptr<Slots>> all_slots;
+
+    const Entry &entry(NameId id) const {
+        return chunks[id >> chunk_bits].load(std::memory_order_acquire)[id & chunk_mask];
+    }
+
+    static std::uint64_t hash_tag(std::size_t name_hash) {
+        return static_cast<std::uint64_t>(name_hash) >> 32 << 32;
+    }
+
+    NameId find_published(std::string_view name, std::size_t name_hash) const {
+        const Slots *table = slots.load(std::memory_order_acquire);
+        if (table == nullptr) {
+            return invalid_id;
+        }
+        std::uint64_t tag = hash_tag(name_hash);
+        for (std::size_t i = name_hash & table->mask;; i = (i + 1) & table->mask) {
+            std::uint64_t word = table->words[i].load(std::memory_order_acquire);
+            if (word == 0) {
+                return invalid_id;
+            }
+            NameId id = static_cast<NameId>((word & 0xFFFFFFFFu) - 1);
+            if ((word & ~std::uint64_t{0xFFFFFFFFu}) == tag && entry(id).name == name) {
+                return id;
+            }
+        }
+    }
+
+    // Writer only: the table is never full, so the probe ends on an empty word
+    static void place(const Slots &table, std::size_t name_hash, NameId id, std::memory_order order) {
+        std::size_t i = name_hash & table.mask;
+        while (table.words[i].load(std::memory_order_relaxed) != 0) {
+            i = (i + 1) & table.mask;
+        }
+        table.words[i].store(hash_tag(name_hash) | (static_cast<std::uint64_t>(id) + 1), order);
+    }
+
+    // Keeps the load under 3/4 by publishing a table twice the size
+    void grow_locked() {
+        const Slots *current = slots.load(std::memory_order_relaxed);
+        std::size_t capacity = current == nullptr ? 16 : current->mask + 1;
+        if (current != nullptr && (static_cast<std::size_t>(count) + 1) * 4 <= capacity * 3) {
+            return;
+        }
+        capacity = current == nullptr ? capacity : capacity * 2;
+        auto table = std::make_unique<Slots>();
+        table->mask = capacity - 1;
+        table->words = std::make_unique<std::atomic<std::uint64_t>[]>(capacity); // Value-initialised to 0
+        for (NameId id = 0; id < count; ++id) {
+            place(*table, entry(id).hash, id, std::memory_order_relaxed);
+        }
+        slots.store(table.get(), std::memory_order_release); // Publishes the words written above
+        all_slots.push_back(std::move(table));
+    }
+
+    NameId intern_locked(std::string_view name, std::size_t name_hash) {
+        NameId id = find_published(name, name_hash);
+        if (id != invalid_id) {
+            return id;
+        }
+        if (count >= max_names) {
+            throw std::length_error("NameTable is full");
+        }
+        id = count;
+        std::size_t chunk_index = id >> chunk_bits;
+        Entry *chunk = chunks[chunk_index].load(std::memory_order_relaxed);
+        if (chunk == nullptr) {
+            chunk = new Entry[chunk_size];
+            chunks[chunk_index].store(chunk, std::memory_order_release);
+        }
+        chunk[id & chunk_mask] = Entry{std::string(name), name_hash};
+        grow_locked();
+        // The release store publishes the entry to readers that find this word
+        place(*slots.load(std::memory_order_relaxed), name_hash, id, std::memory_order_release);
+        ++count;
+        return id;
+    }
+};
 
 class Item {
 private:
-    std::string name;
+    NameId name; // Interned in NameTable::shared()
     int quantity;
-    float price;
+    Money price;
 
 public:
     Item(
-        std::string name,
+        NameId name,
         int quantity,
-        float price
+        Money price
     ) :
-        name{std::move(name)}, // Use std::move for efficiency with string
+        name{name},
         quantity{quantity},
         price{price} {
         // Constructor body can be empty if using initializer list
     }
 
-    // Destructor to confirm item destruction (optional, for debugging)
-    ~Item() {
-        // std::cout << "DEBUG: Item '" << name << "' destroyed." << std::endl;
+    // Destructor to confirm item destruction (optional, for debugging)
+    ~Item() {
+        // std::cout << "DEBUG: Item '" << get_name() << "' destroyed." << std::endl;
+    }
+
+    // Returned by reference so callers don't copy the string
+    const std::string &get_name() const {
+        return NameTable::shared().get_name(name);
+    }
+
+    NameId get_name_id() const {
+        return name;
+    }
+
+    int get_quantity() const {
+        return quantity;
+    }
+
+    void set_quantity(int new_quantity) {
+        quantity = new_quantity;
+    }
+
+    Money get_price() const {
+        return price;
+    }
+
+    // Names are interned, so matching is a single integer compare
+    bool is_match(NameId other_name) const {
+        return name == other_name;
+    }
+};
+
+// Storage backends for Inventory. Both expose the same slot-based interface
+// (find / insert / erase plus per-slot accessors), so Inventory can be built
+// over either one without changing its menu logic.
+
+// Returns an Item to the memory resource it was allocated from
+struct ItemDeleter {
+    std::pmr::memory_resource *resource;
+
+    void operator()(Item *item) const {
+        item->~Item();
+        resource->deallocate(item, sizeof(Item), alignof(Item));
+    }
+};
+
+using ItemPtr = std::unique_ptr<Item, ItemDeleter>;
+
+// One heap-allocated Item per SKU, kept in insertion order.
+//
+// Items and the item vector come from the memory resource given at
+// construction (the global heap by default). Passing a pool such as
+// std::pmr::unsynchronized_pool_resource makes sold-out Items' blocks go onto
+// a free list that the next new SKU reuses, so steady churn does no global
+// allocation. The resource must outlive the store.
+class ItemStore {
+private:
+    // Use std::vector to store unique_ptrs to Item objects
+    std::pmr::vector<ItemPtr> items;
+    NameIndex index; // Name -> position in items, kept in step with every insert and erase
+
+public:
+    explicit ItemStore(std::pmr::memory_resource *resource = std::pmr::get_default_resource()) :
+        items{resource} {
+    }
+
+    std::pmr::memory_resource *get_resource() const {
+        return items.get_allocator().resource();
+    }
+
+    std::size_t size() const {
+        return items.size();
+    }
+
+    bool empty() const {
+        return items.empty();
+    }
+
+    // O(1) lookup through the index instead of a linear find_if over items.
+    // A name that was never interned can't be in any inventory.
+    std::size_t find(std::string_view name) const {
+        const NameTable &names = NameTable::shared();
+        NameId id = names.find(name);
+        if (id == NameTable::invalid_id) {
+            return NameIndex::npos;
+        }
+        return index.find(names.get_hash(id), [&](std::size_t candidate) {
+            return items[candidate]->is_match(id);
+        });
+    }
+
+    void reserve(std::size_t item_count) {
+        items.reserve(item_count);
+        index.reserve(item_count);
+    }
+
+    std::size_t insert(std::string_view name, int quantity, Money price) {
+        NameTable &names = NameTable::shared();
+        NameId id = names.intern(name);
+        std::pmr::memory_resource *resource = get_resource();
+        ItemPtr item{new (resource->allocate(sizeof(Item), alignof(Item))) Item(id, quantity, price),
+                     ItemDeleter{resource}};
+        std::size_t slot = items.size();
+        items.push_back(std::move(item));
+        index.insert(names.get_hash(id), slot);
+        return slot;
+    }
+
+    // Replaces the contents with count items from parallel arrays, e.g. a
+    // mapped snapshot; name(slot) returns each name. The names are interned
+    // under one lock and the index is sized once, but this layout still needs
+    // one Item per SKU.
+    template <typename Names>
+    void assign(std::size_t count, Names name, const std::int32_t *quantities, const std::int64_t *prices) {
+        NameTable &names = NameTable::shared();
+        std::vector<NameId> ids(count);
+        names.intern_all(count, name, ids.data());
+        items.clear();
+        index = NameIndex{};
+        reserve(count);
+        std::pmr::memory_resource *resource = get_resource();
+        for (std::size_t slot = 0; slot < count; ++slot) {
+            items.push_back(ItemPtr{new (resource->allocate(sizeof(Item), alignof(Item)))
+                                        Item(ids[slot], quantities[slot], Money::from_cents(prices[slot])),
+                                    ItemDeleter{resource}});
+            index.insert(names.get_hash(ids[slot]), slot);
+        }
+    }
+
+    void erase(std::size_t slot) {
+        const NameTable &names = NameTable::shared();
+        index.erase(names.get_hash(items[slot]->get_name_id()), slot);
+        // No manual delete needed! unique_ptr handles it.
+        items.erase(items.begin() + slot);
+        // Items after the erased one shifted down by one; re-point their index entries
+        for (std::size_t i = slot; i < items.size(); ++i) {
+            index.relocate(names.get_hash(items[i]->get_name_id()), i + 1, i);
+        }
+    }
+
+    const std::string &get_name(std::size_t slot) const {
+        return items[slot]->get_name();
+    }
+
+    int get_quantity(std::size_t slot) const {
+        return items[slot]->get_quantity();
+    }
+
+    void set_quantity(std::size_t slot, int new_quantity) {
+        items[slot]->set_quantity(new_quantity);
+    }
+
+    Money get_price(std::size_t slot) const {
+        return items[slot]->get_price();
+    }
+
+    // Has to visit every Item through its pointer
+    Money total_value() const {
+        Money total;
+        for (const auto &item : items) {
+            total += item->get_price() * item->get_quantity();
+        }
+        return total;
+    }
+};
+
+// Structure-of-arrays layout: names, quantities and prices live in parallel
+// contiguous arrays, so full scans touch only the fields they need and adding
+// a SKU costs no per-item allocation. Removal swaps the last SKU into the hole,
+// which means listing order is not preserved across sales that empty a slot.
+class SoaItemStore {
+private:
+    std::pmr::vector<NameId> names; // Interned in NameTable::shared()
+    std::pmr::vector<int> quantities;
+    std::pmr::vector<std::int64_t> prices; // In cents
+    NameIndex index;
+
+public:
+    // The arrays come from resource, as in ItemStore
+    explicit SoaItemStore(std::pmr::memory_resource *resource = std::pmr::get_default_resource()) :
+        names{resource},
+        quantities{resource},
+        prices{resource} {
+    }
+
+    std::pmr::memory_resource *get_resource() const {
+        return names.get_allocator().resource();
+    }
+
+    std::size_t size() const {
+        return names.size();
+    }
+
+    bool empty() const {
+        return names.empty();
+    }
+
+    std::size_t find(std::string_view name) const {
+        const NameTable &table = NameTable::shared();
+        NameId id = table.find(name);
+        if (id == NameTable::invalid_id) {
+            return NameIndex::npos;
+        }
+        return index.find(table.get_hash(id), [&](std::size_t candidate) {
+            return names[candidate] == id;
+        });
+    }
+
+    void reserve(std::size_t item_count) {
+        names.reserve(item_count);
+        quantities.reserve(item_count);
+        prices.reserve(item_count);
+        index.reserve(item_count);
+    }
+
+    std::size_t insert(std::string_view name, int quantity, Money price) {
+        NameTable &table = NameTable::shared();
+        NameId id = table.intern(name);
+        std::size_t slot = names.size();
+        index.insert(table.get_hash(id), slot);
+        names.push_back(id);
+        quantities.push_back(quantity);
+        prices.push_back(price.get_cents());
+        return slot;
+    }
+
+    // Replaces the contents with count items from parallel arrays, e.g. a
+    // mapped snapshot: quantities and prices are copied as whole arrays, the
+    // names interned under one lock and the index sized once
+    template <typename Names>
+    void assign(std::size_t count, Names name, const std::int32_t *new_quantities, const std::int64_t *new_prices) {
+        NameTable &table = NameTable::shared();
+        names.resize(count);
+        table.intern_all(count, name, names.data());
+        quantities.assign(new_quantities, new_quantities + count);
+        prices.assign(new_prices, new_prices + count);
+        index = NameIndex{};
+        index.reserve(count);
+        for (std::size_t slot = 0; slot < count; ++slot) {
+            index.insert(table.get_hash(names[slot]), slot);
+        }
+    }
+
+    // Swap-and-pop: O(1), only the moved SKU's index entry changes
+    void erase(std::size_t slot) {
+        const NameTable &table = NameTable::shared();
+        std::size_t last = names.size() - 1;
+        index.erase(table.get_hash(names[slot]), slot);
+        if (slot != last) {
+            index.relocate(table.get_hash(names[last]), last, slot);
+            names[slot] = names[last];
+            quantities[slot] = quantities[last];
+            prices[slot] = prices[last];
+        }
+        names.pop_back();
+        quantities.pop_back();
+        prices.pop_back();
+    }
+
+    const std::string &get_name(std::size_t slot) const {
+        return NameTable::shared().get_name(names[slot]);
+    }
+
+    int get_quantity(std::size_t slot) const {
+        return quantities[slot];
+    }
+
+    void set_quantity(std::size_t slot, int new_quantity) {
+        quantities[slot] = new_quantity;
+    }
+
+    Money get_price(std::size_t slot) const {
+        return Money::from_cents(prices[slot]);
+    }
+
+    // One contiguous pass over the quantity and price arrays
+    Money total_value() const {
+        return Money::from_cents(sum_of_products(quantities.data(), prices.data(), quantities.size()));
+    }
+
+    // Contiguous views for whole-inventory scans
+    const int *quantity_data() const {
+        return quantities.data();
+    }
+
+    const std::int64_t *price_data() const {
+        return prices.data();
+    }
+};
+
+// The original layout: one Item per SKU and a linear std::find_if comparing
+// names on every lookup. Kept only as the baseline for --bench.
+class LinearItemStore {
+private:
+    std::pmr::vector<ItemPtr> items;
+
+public:
+    explicit LinearItemStore(std::pmr::memory_resource *resource = std::pmr::get_default_resource()) :
+        items{resource} {
+    }
+
+    std::pmr::memory_resource *get_resource() const {
+        return items.get_allocator().resource();
+    }
+
+    std::size_t size() const {
+        return items.size();
+    }
+
+    bool empty() const {
+        return items.empty();
+    }
+
+    std::size_t find(std::string_view name) const {
+        auto it = std::find_if(items.begin(), items.end(), [&](const ItemPtr &item) {
+            return item->get_name() == name;
+        });
+        return it == items.end() ? NameIndex::npos : static_cast<std::size_t>(it - items.begin());
+    }
+
+    void reserve(std::size_t item_count) {
+        items.reserve(item_count);
+    }
+
+    std::size_t insert(std::string_view name, int quantity, Money price) {
+        NameId id = NameTable::shared().intern(name);
+        std::pmr::memory_resource *resource = get_resource();
+        items.push_back(ItemPtr{new (resource->allocate(sizeof(Item), alignof(Item))) Item(id, quantity, price),
+                                ItemDeleter{resource}});
+        return items.size() - 1;
+    }
+
+    template <typename Names>
+    void assign(std::size_t count, Names name, const std::int32_t *quantities, const std::int64_t *prices) {
+        items.clear();
+        items.reserve(count);
+        for (std::size_t slot = 0; slot < count; ++slot) {
+            insert(name(slot), quantities[slot], Money::from_cents(prices[slot]));
+        }
+    }
+
+    void erase(std::size_t slot) {
+        items.erase(items.begin() + slot);
+    }
+
+    const std::string &get_name(std::size_t slot) const {
+        return items[slot]->get_name();
+    }
+
+    int get_quantity(std::size_t slot) const {
+        return items[slot]->get_quantity();
+    }
+
+    void set_quantity(std::size_t slot, int new_quantity) {
+        items[slot]->set_quantity(new_quantity);
+    }
+
+    Money get_price(std::size_t slot) const {
+        return items[slot]->get_price();
+    }
+
+    Money total_value() const {
+        Money total;
+        for (const auto &item : items) {
+            total += item->get_price() * item->get_quantity();
+        }
+        return total;
+    }
+};
+
+// Binary inventory snapshot, laid out so a memory-mapped file can be used in
+// place without parsing:
+//
+//   SnapshotHeader
+//   int64  prices[item_count]            (cents)
+//   uint64 name_offsets[item_count + 1]  (into the string table)
+//   int32  quantities[item_count]
+//   char   string_table[name_bytes]      (names back to back, no terminators)
+//
+// Every array starts on an 8-byte boundary. Values are in host byte order.
+struct SnapshotHeader {
+    char magic[8];
+    std::uint32_t version;
+    std::uint32_t header_size;
+    std::uint64_t item_count;
+    std::uint64_t name_bytes;
+    std::int64_t total_money_cents;
+    std::uint64_t log_generation; // Transaction log generation already folded into this snapshot (0 = none)
+    std::uint64_t prices_offset;
+    std::uint64_t name_offsets_offset;
+    std::uint64_t quantities_offset;
+    std::uint64_t string_table_offset;
+    std::uint64_t file_size;
+};
+
+constexpr char snapshot_magic[8] = {'I', 'N', 'V', 'S', 'N', 'A', 'P', '1'};
+constexpr std::uint32_t snapshot_version = 2; // 2 added log_generation
+
+inline std::uint64_t align_to_8(std::uint64_t offset) {
+    return (offset + 7) & ~static_cast<std::uint64_t>(7);
+}
+
+// Fills in every offset of header from its item_count and name_bytes
+inline void layout_snapshot(SnapshotHeader &header) {
+    std::uint64_t count = header.item_count;
+    header.prices_offset = align_to_8(sizeof(SnapshotHeader));
+    header.name_offsets_offset = align_to_8(header.prices_offset + count * sizeof(std::int64_t));
+    header.quantities_offset = align_to_8(header.name_offsets_offset + (count + 1) * sizeof(std::uint64_t));
+    header.string_table_offset = align_to_8(header.quantities_offset + count * sizeof(std::int32_t));
+    header.file_size = header.string_table_offset + header.name_bytes;
+}
+
+// Read-only memory-mapped view of a snapshot file. The arrays point straight
+// into the mapping, so opening costs one mmap plus a header check.
+class SnapshotView {
+private:
+    const char *base = nullptr;
+    std::size_t mapped_size = 0;
+    SnapshotHeader header{};
+
+    void unmap() {
+        if (base != nullptr) {
+            munmap(const_cast<char *>(base), mapped_size);
+            base = nullptr;
+            mapped_size = 0;
+        }
+    }
+
+public:
+    SnapshotView() = default;
+
+    SnapshotView(const SnapshotView &) = delete;
+    SnapshotView &operator=(const SnapshotView &) = delete;
+
+    ~SnapshotView() {
+        unmap();
+    }
+
+    // Maps the file and validates its header and layout. Returns false if the
+    // file can't be read or isn't a well-formed snapshot.
+    bool open(const std::string &path) {
+        unmap();
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) {
+            return false;
+        }
+        struct stat info;
+        if (fstat(fd, &info) != 0 || static_cast<std::uint64_t>(info.st_size) < sizeof(SnapshotHeader)) {
+            ::close(fd);
+            return false;
+        }
+        std::size_t size = static_cast<std::size_t>(info.st_size);
+        void *mapping = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        ::close(fd); // The mapping stays valid after the descriptor is closed
+        if (mapping == MAP_FAILED) {
+            return false;
+        }
+        base = static_cast<const char *>(mapping);
+        mapped_size = size;
+
+        std::memcpy(&header, base, sizeof(header));
+        SnapshotHeader expected = header;
+        layout_snapshot(expected);
+        bool valid = std::memcmp(header.magic, snapshot_magic, sizeof(snapshot_magic)) == 0
+                     && header.version == snapshot_version
+                     && header.header_size == sizeof(SnapshotHeader)
+                     && header.item_count <= size / sizeof(std::int64_t)
+                     && header.name_bytes <= size
+                     && header.prices_offset == expected.prices_offset
+                     && header.name_offsets_offset == expected.name_offsets_offset
+                     && header.quantities_offset == expected.quantities_offset
+                     && header.string_table_offset == expected.string_table_offset
+                     && header.file_size == expected.file_size
+                     && header.file_size == size
+                     && name_offsets()[header.item_count] == header.name_bytes;
+        if (!valid) {
+            unmap();
+        }
+        return valid;
+    }
+
+    std::size_t size() const {
+        return static_cast<std::size_t>(header.item_count);
+    }
+
+    Money get_total_money() const {
+        return Money::from_cents(header.total_money_cents);
+    }
+
+    std::uint64_t get_log_generation() const {
+        return header.log_generation;
+    }
+
+    const std::int64_t *price_data() const {
+        return reinterpret_cast<const std::int64_t *>(base + header.prices_offset);
+    }
+
+    const std::uint64_t *name_offsets() const {
+        return reinterpret_cast<const std::uint64_t *>(base + header.name_offsets_offset);
+    }
+
+    const std::int32_t *quantity_data() const {
+        return reinterpret_cast<const std::int32_t *>(base + header.quantities_offset);
+    }
+
+    // Returns an empty view for an offset pair that doesn't fit the string table
+    std::string_view get_name(std::size_t slot) const {
+        std::uint64_t begin = name_offsets()[slot];
+        std::uint64_t end = name_offsets()[slot + 1];
+        if (begin > end || end > header.name_bytes) {
+            return {};
+        }
+        return std::string_view(base + header.string_table_offset + begin, static_cast<std::size_t>(end - begin));
+    }
+};
+
+// Makes a rename or file creation in path's directory durable
+inline bool fsync_parent_directory(const std::string &path) {
+    std::size_t slash = path.rfind('/');
+    std::string directory = slash == std::string::npos ? "." : slash == 0 ? "/" : path.substr(0, slash);
+    int fd = ::open(directory.c_str(), O_RDONLY | O_DIRECTORY);
+    if (fd < 0) {
+        return false;
+    }
+    bool synced = fsync(fd) == 0;
+    return ::close(fd) == 0 && synced;
+}
+
+// Writes a snapshot of store to path atomically: the data goes to a
+// temporary file that is fsynced and then renamed over the target, so readers
+// only ever see the old snapshot or the complete new one. The directory is
+// fsynced too, so the rename itself survives a crash.
+template <typename Store>
+bool write_snapshot(const std::string &path, const Store &items, Money total_money, std::uint64_t log_generation = 0) {
+    SnapshotHeader header{};
+    std::memcpy(header.magic, snapshot_magic, sizeof(snapshot_magic));
+    header.version = snapshot_version;
+    header.header_size = sizeof(SnapshotHeader);
+    header.item_count = items.size();
+    header.total_money_cents = total_money.get_cents();
+    header.log_generation = log_generation;
+    for (std::size_t slot = 0; slot < items.size(); ++slot) {
+        header.name_bytes += items.get_name(slot).size();
+    }
+    layout_snapshot(header);
+
+    std::vector<char> image(static_cast<std::size_t>(header.file_size), 0);
+    std::memcpy(image.data(), &header, sizeof(header));
+    char *prices = image.data() + header.prices_offset;
+    char *name_offsets = image.data() + header.name_offsets_offset;
+    char *quantities = image.data() + header.quantities_offset;
+    char *string_table = image.data() + header.string_table_offset;
+    std::uint64_t name_offset = 0;
+    for (std::size_t slot = 0; slot < items.size(); ++slot) {
+        std::int64_t cents = items.get_price(slot).get_cents();
+        std::int32_t quantity = items.get_quantity(slot);
+        const std::string &name = items.get_name(slot);
+        std::memcpy(prices + slot * sizeof(cents), &cents, sizeof(cents));
+        std::memcpy(quantities + slot * sizeof(quantity), &quantity, sizeof(quantity));
+        std::memcpy(name_offsets + slot * sizeof(name_offset), &name_offset, sizeof(name_offset));
+        std::memcpy(string_table + name_offset, name.data(), name.size());
+        name_offset += name.size();
+    }
+    std::memcpy(name_offsets + items.size() * sizeof(name_offset), &name_offset, sizeof(name_offset));
+
+    std::string temp_path = path + ".tmp";
+    int fd = ::open(temp_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        return false;
+    }
+    const char *cursor = image.data();
+    std::size_t remaining = image.size();
+    while (remaining > 0) {
+        ssize_t written = ::write(fd, cursor, remaining);
+        if (written <= 0) {
+            ::close(fd);
+            ::unlink(temp_path.c_str());
+            return false;
+        }
+        cursor += written;
+        remaining -= static_cast<std::size_t>(written);
+    }
+    bool synced = fsync(fd) == 0;
+    if (::close(fd) != 0 || !synced || std::rename(temp_path.c_str(), path.c_str()) != 0) {
+        ::unlink(temp_path.c_str());
+        return false;
+    }
+    return fsync_parent_directory(path);
+}
+
+// Programmatic (non-interactive) transactions, so an inventory can be driven
+// from a server or a replayed sales log instead of std::cin prompts
+enum class TransactionType {
+    Add,
+    Sell
+};
+
+struct Transaction {
+    TransactionType type;
+    std::string_view name; // Must stay valid until the batch has been applied
+    int quantity;
+    Money price; // Only used by Add when the item is new
+};
+
+enum class TransactionStatus {
+    Added,             // New item inserted
+    Merged,            // Existing item, quantity increased
+    Sold,              // Sale completed, item still in stock
+    SoldOut,           // Sale completed and the item was removed at zero
+    NotFound,          // Sell of an item that is not in the inventory
+    InsufficientStock, // Sell of more than is in stock; nothing changed
+    InvalidQuantity,   // Quantity was not positive
+    InvalidPrice       // Negative price on an Add
+};
+
+struct TransactionResult {
+    TransactionStatus status;
+    int quantity;        // Quantity in stock after the transaction (before it, on InsufficientStock)
+    Money money_earned;  // Revenue from a sale, 0 otherwise
+};
+
+// Append-only write-ahead log of inventory transactions.
+//
+// The file starts with a 16-byte header (magic + generation) followed by
+// records of a fixed 24-byte head and the name bytes:
+//
+//   uint32 checksum   (FNV-1a of everything after this field)
+//   uint8  type       (TransactionType; any other value ends replay like a bad checksum)
+//   uint8  unused[3]
+//   int32  quantity
+//   uint32 name_size
+//   int64  price_cents
+//   char   name[name_size]
+//
+// Appends only go to an in-memory buffer. Durability comes from
+// wait_durable(): the first waiter becomes the leader and writes and fsyncs
+// everything appended so far, and every thread waiting behind it is covered by
+// that one fsync (group commit). A torn record at the tail, left by a crash
+// mid-write, fails its checksum and ends replay; open() truncates it away.
+//
+// Each snapshot records the log generation it already contains. Saving a
+// snapshot starts a new generation, so a log left over from before the
+// snapshot is recognised and skipped instead of being applied twice.
+constexpr char log_magic[8] = {'I', 'N', 'V', 'L', 'O', 'G', '0', '1'};
+constexpr std::size_t log_header_size = 16;
+constexpr std::size_t log_record_head_size = 24;
+
+inline std::uint32_t log_checksum(const char *data, std::size_t size) {
+    std::uint32_t hash = 2166136261u;
+    for (std::size_t i = 0; i < size; ++i) {
+        hash = (hash ^ static_cast<unsigned char>(data[i])) * 16777619u;
+    }
+    return hash;
+}
+
+inline bool write_fully(int fd, const char *data, std::size_t size) {
+    while (size > 0) {
+        ssize_t written = ::write(fd, data, size);
+        if (written <= 0) {
+            return false;
+        }
+        data += written;
+        size -= static_cast<std::size_t>(written);
+    }
+    return true;
+}
+
+// Calls handler(type, name, quantity, price) for every intact record of the
+// log at path. Reports the file's generation and the byte length of the intact
+// prefix. Returns false if the file is missing or isn't a transaction log.
+template <typename Handler>
+bool read_transaction_log(const std::string &path, std::uint64_t &generation, std::uint64_t &valid_size, Handler handler) {
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+    std::vector<char> contents;
+    char chunk[1 << 16];
+    ssize_t got;
+    while ((got = ::read(fd, chunk, sizeof(chunk))) > 0) {
+        contents.insert(contents.end(), chunk, chunk + got);
+    }
+    ::close(fd);
+    if (got < 0 || contents.size() < log_header_size || std::memcmp(contents.data(), log_magic, sizeof(log_magic)) != 0) {
+        return false;
+    }
+    std::memcpy(&generation, contents.data() + sizeof(log_magic), sizeof(generation));
+
+    std::size_t offset = log_header_size;
+    while (contents.size() - offset >= log_record_head_size) {
+        const char *record = contents.data() + offset;
+        std::uint32_t checksum;
+        std::int32_t quantity;
+        std::uint32_t name_size;
+        std::int64_t price_cents;
+        std::memcpy(&checksum, record, sizeof(checksum));
+        std::memcpy(&quantity, record + 8, sizeof(quantity));
+        std::memcpy(&name_size, record + 12, sizeof(name_size));
+        std::memcpy(&price_cents, record + 16, sizeof(price_cents));
+        std::size_t record_size = log_record_head_size + name_size;
+        if (contents.size() - offset < record_size || log_checksum(record + 4, record_size - 4) != checksum) {
+            break; // Torn or corrupt tail
+        }
+        if (record[4] != static_cast<char>(TransactionType::Add) && record[4] != static_cast<char>(TransactionType::Sell)) {
+            break; // Not a type this log writes, so not a record to trust either
+        }
+        handler(static_cast<TransactionType>(record[4]),
+                std::string_view(record + log_record_head_size, name_size),
+                quantity,
+                Money::from_cents(price_cents));
+        offset += record_size;
+    }
+    valid_size = offset;
+    return true;
+}
+
+class TransactionLog {
+private:
+    int fd = -1;
+    std::uint64_t generation = 0;
+
+    mutable std::mutex lock;
+    std::condition_variable flushed;
+    std::string pending;         // Encoded records not yet written
+    std::uint64_t appended = 0;  // Sequence number of the last appended record
+    std::uint64_t durable = 0;   // Sequence number of the last fsynced record
+    bool flushing = false;       // A leader is writing outside the lock
+    bool failed = false;         // Sticky: a write or fsync failed
+
+    bool write_header(std::uint64_t new_generation) {
+        char header[log_header_size];
+        std::memcpy(header, log_magic, sizeof(log_magic));
+        std::memcpy(header + sizeof(log_magic), &new_generation, sizeof(new_generation));
+        return write_fully(fd, header, sizeof(header)) && fsync(fd) == 0;
+    }
+
+public:
+    TransactionLog() = default;
+
+    TransactionLog(const TransactionLog &) = delete;
+    TransactionLog &operator=(const TransactionLog &) = delete;
+
+    ~TransactionLog() {
+        if (fd >= 0) {
+            commit();
+            ::close(fd);
+        }
+    }
+
+    // Opens path for appending and cuts off any torn record at the tail. A
+    // missing log, or one older than min_generation, is started over empty as
+    // min_generation: pass one past the loaded snapshot's generation, so a log
+    // the snapshot already absorbed (a crash between writing the snapshot and
+    // begin_next_generation) isn't appended to and then skipped on replay.
+    bool open(const std::string &path, std::uint64_t min_generation = 1) {
+        std::uint64_t existing_generation = 0;
+        std::uint64_t valid_size = 0;
+        bool exists = read_transaction_log(path, existing_generation, valid_size,
+                                           [](TransactionType, std::string_view, int, Money) {});
+        fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_APPEND, 0644);
+        if (fd < 0) {
+            return false;
+        }
+        if (exists && existing_generation >= min_generation) {
+            generation = existing_generation;
+            return ftruncate(fd, static_cast<off_t>(valid_size)) == 0;
+        }
+        generation = std::max<std::uint64_t>(min_generation, 1);
+        return ftruncate(fd, 0) == 0 && write_header(generation) && fsync_parent_directory(path);
+    }
+
+    std::uint64_t get_generation() const {
+        return generation;
+    }
+
+    bool has_failed() const {
+        std::lock_guard<std::mutex> guard(lock);
+        return failed;
+    }
+
+    // Buffers one record and returns its sequence number. Not durable until
+    // wait_durable() for that number (or commit()) returns true.
+    std::uint64_t append(TransactionType type, std::string_view name, int quantity, Money price) {
+        char head[log_record_head_size] = {};
+        std::int32_t quantity_field = quantity;
+        std::uint32_t name_size = static_cast<std::uint32_t>(name.size());
+        std::int64_t price_cents = price.get_cents();
+        head[4] = static_cast<char>(type);
+        std::memcpy(head + 8, &quantity_field, sizeof(quantity_field));
+        std::memcpy(head + 12, &name_size, sizeof(name_size));
+        std::memcpy(head + 16, &price_cents, sizeof(price_cents));
+        std::uint32_t checksum = log_checksum(head + 4, log_record_head_size - 4);
+        // Continue the FNV-1a hash over the name bytes
+        for (char c : name) {
+            checksum = (checksum ^ static_cast<unsigned char>(c)) * 16777619u;
+        }
+        std::memcpy(head, &checksum, sizeof(checksum));
+
+        std::lock_guard<std::mutex> guard(lock);
+        pending.append(head, sizeof(head));
+        pending.append(name.data(), name.size());
+        return ++appended;
     }
 
-    std::string get_name() const {
-        return name;
+    // Blocks until the record with this sequence number is on disk
+    bool wait_durable(std::uint64_t sequence) {
+        std::unique_lock<std::mutex> guard(lock);
+        while (durable < sequence && !failed) {
+            if (flushing) {
+                flushed.wait(guard);
+                continue;
+            }
+            // Become the leader: one write and one fsync for everything appended so far
+            flushing = true;
+            std::string batch;
+            batch.swap(pending);
+            std::uint64_t batch_end = appended;
+            guard.unlock();
+            bool ok = write_fully(fd, batch.data(), batch.size()) && fdatasync(fd) == 0;
+            guard.lock();
+            flushing = false;
+            if (ok) {
+                durable = batch_end;
+            } else {
+                failed = true;
+            }
+            flushed.notify_all();
+        }
+        return durable >= sequence;
     }
 
-    int get_quantity() const {
-        return quantity;
+    // Makes everything appended so far durable
+    bool commit() {
+        std::uint64_t sequence;
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            sequence = appended;
+        }
+        return wait_durable(sequence);
     }
 
-    void set_quantity(int new_quantity) {
-        quantity = new_quantity;
+    // Called once a snapshot containing generation get_generation() is safely
+    // on disk: empties the log and starts the next generation. The file is
+    // swapped under the lock once no leader is writing, and no new leader can
+    // start until it is done.
+    bool begin_next_generation() {
+        if (!commit()) {
+            return false;
+        }
+        std::unique_lock<std::mutex> guard(lock);
+        flushed.wait(guard, [this] { return !flushing; });
+        if (failed || ftruncate(fd, 0) != 0 || !write_header(generation + 1)) {
+            failed = true;
+            return false;
+        }
+        ++generation;
+        return true;
     }
+};
 
-    float get_price() const {
-        return price;
+// Inventory rules shared by every inventory type, written against the store
+// interface: adding merges into an existing item, selling never takes more
+// than is in stock and removes the item when it reaches zero.
+template <typename Store>
+TransactionResult add_to_store(Store &items, std::string_view name, int quantity, Money price) {
+    if (quantity <= 0) {
+        return {TransactionStatus::InvalidQuantity, 0, Money{}};
+    }
+    std::size_t slot = items.find(name);
+    if (slot != NameIndex::npos) {
+        int new_quantity = items.get_quantity(slot) + quantity;
+        items.set_quantity(slot, new_quantity);
+        return {TransactionStatus::Merged, new_quantity, Money{}};
+    }
+    if (price < Money{}) {
+        return {TransactionStatus::InvalidPrice, 0, Money{}};
     }
+    items.insert(name, quantity, price);
+    return {TransactionStatus::Added, quantity, Money{}};
+}
 
-    // Changed to const reference for efficiency and correctness
-    bool is_match(const std::string &other_name) const {
-        return name == other_name;
+template <typename Store>
+TransactionResult sell_from_store(Store &items, std::size_t slot, int quantity) {
+    int current_quantity = items.get_quantity(slot);
+    if (quantity <= 0) {
+        return {TransactionStatus::InvalidQuantity, current_quantity, Money{}};
     }
-};
+    if (quantity > current_quantity) {
+        return {TransactionStatus::InsufficientStock, current_quantity, Money{}};
+    }
+    Money money_earned = items.get_price(slot) * quantity;
+    int remaining = current_quantity - quantity;
+    if (remaining == 0) {
+        items.erase(slot);
+        return {TransactionStatus::SoldOut, 0, money_earned};
+    }
+    items.set_quantity(slot, remaining);
+    return {TransactionStatus::Sold, remaining, money_earned};
+}
 
-class Inventory {
+template <typename Store>
+class BasicInventory {
 private:
-    // Use std::vector to store unique_ptrs to Item objects
-    std::vector<std::unique_ptr<Item>> items;
-    float total_money;
+    Store items;
+    Money total_money;
     // item_count is no longer needed; items.size() provides it
+    TransactionLog *log = nullptr;              // Not owned; null when not logging
+    std::uint64_t snapshot_log_generation = 0;  // Log generation contained in the loaded snapshot
+    std::string listing_buffer; // Reused across list_items calls to avoid reallocating
+    std::vector<std::pair<std::size_t, std::size_t>> bulk_order; // Reused by add_bulk: (name hash, batch index)
+    std::vector<Transaction> loot_adds; // Reused by add_loot
+
+    static void append_number(std::string &out, int value) {
+        char digits[16];
+        auto result = std::to_chars(digits, digits + sizeof(digits), value);
+        out.append(digits, result.ptr);
+    }
+
+    static void append_number(std::string &out, Money value) {
+        value.append_to(out);
+    }
 
-    // Changed to take const reference to Item for efficiency
-    static void display_data(const Item &item) {
-        std::cout << "\nItem name: " << item.get_name();
-        std::cout << "\nQuantity: " << item.get_quantity();
-        std::cout << "\nPrice: " << item.get_price();
+    void display_data(std::string &out, std::size_t slot) const {
+        out += "\nItem name: ";
+        out += items.get_name(slot);
+        out += "\nQuantity: ";
+        append_number(out, items.get_quantity(slot));
+        out += "\nPrice: ";
+        append_number(out, items.get_price(slot));
     }
 
 public:
-    Inventory() :
-        total_money{0} { // items is default-constructed (empty vector)
+    BasicInventory() :
+        total_money{} { // items is default-constructed (empty store)
+    }
+
+    // Allocates the store's items from resource, e.g. a pool for churn-heavy stock
+    explicit BasicInventory(std::pmr::memory_resource *resource) :
+        items{resource},
+        total_money{} {
     }
 
     // Rule of Five: If you manage raw pointers/resources, you need custom
     // copy constructor, copy assignment, move constructor, move assignment, and destructor.
-    // By using unique_ptr, the default move operations are fine, and copy operations are deleted.
-    // Destructor of Inventory will automatically destroy all unique_ptrs, which in turn
-    // destroy the Item objects. No manual loop needed for deletion.
+    // Both stores own their data through standard containers, so the defaults are fine.
+
+    // Core add: merges into an existing item or inserts a new one.
+    // Shared by the interactive menu and the batch API.
+    TransactionResult add(std::string_view name, int quantity, Money price) {
+        GAME_SPAN("Inventory::add");
+        GAME_COUNT("inventory.add", 1);
+        TransactionResult result = add_to_store(items, name, quantity, price);
+        if (log != nullptr && (result.status == TransactionStatus::Added || result.status == TransactionStatus::Merged)) {
+            log->append(TransactionType::Add, name, quantity, price);
+        }
+        return result;
+    }
+
+    // Core sell of an item already located in the store; removes it at zero
+    TransactionResult sell(std::size_t slot, int quantity) {
+        GAME_SPAN_DETAIL("Inventory::sell", items.get_name(slot).c_str()); // Interned, so the name outlives the item
+        GAME_COUNT("inventory.sell", 1);
+        // Logged before applying, while the slot still holds the name
+        if (log != nullptr && quantity > 0 && quantity <= items.get_quantity(slot)) {
+            log->append(TransactionType::Sell, items.get_name(slot), quantity, Money{});
+        }
+        TransactionResult result = sell_from_store(items, slot, quantity);
+        total_money += result.money_earned;
+        return result;
+    }
+
+    // The span covers the lookup; the nested Inventory::sell span is the sale itself
+    TransactionResult sell(std::string_view name, int quantity) {
+        GAME_SPAN("Inventory::sell_by_name");
+        std::size_t slot = items.find(name);
+        if (slot == NameIndex::npos) {
+            GAME_COUNT("inventory.not_found", 1);
+            return {TransactionStatus::NotFound, 0, Money{}};
+        }
+        return sell(slot, quantity);
+    }
+
+    // Applies count transactions in order, writing one result per transaction.
+    // Each transaction sees the effects of the ones before it in the batch.
+    // With a log attached the whole batch shares one fsync; returns false if
+    // it could not be made durable.
+    bool apply(const Transaction *transactions, std::size_t count, TransactionResult *results) {
+        for (std::size_t i = 0; i < count; ++i) {
+            const Transaction &txn = transactions[i];
+            results[i] = txn.type == TransactionType::Add
+                             ? add(txn.name, txn.quantity, txn.price)
+                             : sell(txn.name, txn.quantity);
+        }
+        return commit_log();
+    }
+
+    // Adds count items in one pass, e.g. a tick's loot for one player, with
+    // the same results add() would give one at a time (transaction types are
+    // ignored). The batch is sorted by name hash first so each distinct item
+    // costs one lookup and one merge or insert however often it repeats, and
+    // one log record; the whole batch shares one fsync. New items are stored
+    // in hash order rather than batch order.
+    bool add_bulk(const Transaction *adds, std::size_t count, TransactionResult *results) {
+        GAME_SPAN("Inventory::add_bulk");
+        bulk_order.clear();
+        for (std::size_t i = 0; i < count; ++i) {
+            if (adds[i].quantity <= 0) {
+                results[i] = {TransactionStatus::InvalidQuantity, 0, Money{}};
+            } else {
+                bulk_order.emplace_back(NameIndex::hash(adds[i].name), i);
+            }
+        }
+        std::sort(bulk_order.begin(), bulk_order.end()); // Equal hashes keep batch order
+        items.reserve(items.size() + bulk_order.size());
+
+        std::size_t distinct = 0;
+        for (std::size_t run = 0; run < bulk_order.size();) {
+            std::string_view name = adds[bulk_order[run].second].name;
+            std::size_t run_end = run + 1;
+            bool collided = false;
+            while (run_end < bulk_order.size() && bulk_order[run_end].first == bulk_order[run].first) {
+                collided = collided || adds[bulk_order[run_end].second].name != name;
+                ++run_end;
+            }
+            if (collided) {
+                // Different names with one hash: rare enough to add one by one
+                for (std::size_t i = run; i < run_end; ++i) {
+                    const Transaction &txn = adds[bulk_order[i].second];
+                    results[bulk_order[i].second] = add(txn.name, txn.quantity, txn.price);
+                }
+                run = run_end;
+                continue;
+            }
+            std::size_t slot = items.find(name);
+            std::size_t next = run;
+            if (slot == NameIndex::npos) {
+                // Until one of them inserts the item, a negative price is rejected
+                while (next < run_end && adds[bulk_order[next].second].price < Money{}) {
+                    results[bulk_order[next++].second] = {TransactionStatus::InvalidPrice, 0, Money{}};
+                }
+            }
+            if (next < run_end) {
+                const Transaction &first = adds[bulk_order[next].second];
+                int quantity = slot == NameIndex::npos ? 0 : items.get_quantity(slot);
+                int added = 0;
+                for (std::size_t i = next; i < run_end; ++i) {
+                    quantity += adds[bulk_order[i].second].quantity;
+                    added += adds[bulk_order[i].second].quantity;
+                    results[bulk_order[i].second] = {TransactionStatus::Merged, quantity, Money{}};
+                }
+                if (slot == NameIndex::npos) {
+                    items.insert(name, quantity, first.price);
+                    results[bulk_order[next].second].status = TransactionStatus::Added;
+                } else {
+                    items.set_quantity(slot, quantity);
+                }
+                if (log != nullptr) {
+                    log->append(TransactionType::Add, name, added, first.price);
+                }
+                ++distinct;
+            }
+            run = run_end;
+        }
+        GAME_COUNT("inventory.add", distinct);
+        return commit_log();
+    }
+
+    // Adds one recipient's drops from LootPipeline::distribute with add_bulk;
+    // new items enter at their loot table price. The loot table must outlive
+    // the call.
+    bool add_loot(const LootDrop *drops, std::size_t count, TransactionResult *results) {
+        loot_adds.clear();
+        for (std::size_t i = 0; i < count; ++i) {
+            const LootEntry &entry = *drops[i].entry;
+            loot_adds.push_back({TransactionType::Add, entry.item, drops[i].quantity, Money::from_cents(entry.priceCents)});
+        }
+        return add_bulk(loot_adds.data(), loot_adds.size(), results);
+    }
+
+    // Same as above, resizing results to one per transaction
+    bool apply(const std::vector<Transaction> &transactions, std::vector<TransactionResult> &results) {
+        results.resize(transactions.size());
+        return apply(transactions.data(), transactions.size(), results.data());
+    }
+
+    // Every successful add/sell from now on is appended to transaction_log
+    void attach_log(TransactionLog *transaction_log) {
+        log = transaction_log;
+    }
+
+    bool commit_log() {
+        return log == nullptr || log->commit();
+    }
+
+    // Startup: replays the log at path, then opens it with transaction_log
+    // (no older than the loaded snapshot) and attaches it. Call after
+    // load_snapshot. Returns false if the log can't be opened.
+    bool open_log(TransactionLog &transaction_log, const std::string &path, std::size_t &replayed) {
+        replayed = replay_log(path);
+        if (!transaction_log.open(path, snapshot_log_generation + 1)) {
+            return false;
+        }
+        attach_log(&transaction_log);
+        return true;
+    }
+
+    // Re-applies the log at path on top of the current contents, unless the
+    // loaded snapshot already includes its generation. Call before attach_log.
+    // Returns the number of records applied.
+    std::size_t replay_log(const std::string &path) {
+        std::uint64_t generation = 0;
+        std::uint64_t valid_size = 0;
+        std::size_t applied = 0;
+        TransactionLog *attached = log;
+        log = nullptr; // Replayed transactions must not be logged again
+        read_transaction_log(path, generation, valid_size,
+                             [&](TransactionType type, std::string_view name, int quantity, Money price) {
+                                 if (generation <= snapshot_log_generation) {
+                                     return;
+                                 }
+                                 if (type == TransactionType::Add) {
+                                     add(name, quantity, price);
+                                 } else {
+                                     sell(name, quantity);
+                                 }
+                                 ++applied;
+                             });
+        log = attached;
+        return applied;
+    }
+
+    std::size_t size() const {
+        return items.size();
+    }
+
+    Money get_total_money() const {
+        return total_money;
+    }
+
+    // Value of everything currently in stock at unit price
+    Money total_value() const {
+        return items.total_value();
+    }
+
+    // With a log attached, the snapshot absorbs the current log generation and
+    // the log then starts over with the next one
+    bool save_snapshot(const std::string &path) {
+        std::uint64_t generation = 0;
+        if (log != nullptr) {
+            if (!log->commit()) {
+                return false;
+            }
+            generation = log->get_generation();
+        }
+        if (!write_snapshot(path, items, total_money, generation)) {
+            return false;
+        }
+        snapshot_log_generation = generation;
+        return log == nullptr || log->begin_next_generation();
+    }
+
+    // Replaces the whole inventory with the snapshot's contents. On failure
+    // the inventory is left unchanged.
+    bool load_snapshot(const std::string &path) {
+        SnapshotView snapshot;
+        if (!snapshot.open(path)) {
+            return false;
+        }
+        Store loaded(items.get_resource());
+        loaded.assign(snapshot.size(), [&snapshot](std::size_t slot) { return snapshot.get_name(slot); },
+                      snapshot.quantity_data(), snapshot.price_data());
+        items = std::move(loaded);
+        total_money = snapshot.get_total_money();
+        snapshot_log_generation = snapshot.get_log_generation();
+        return true;
+    }
 
     // A better way to add item: accept data, or a unique_ptr
     void add_item() {
         std::string name;
         int quantity;
-        float price;
+        std::string price_text;
+        Money price;
 
         // Clear input buffer before reading string
         std::cin.ignore(std::numeric_limits<std::streamsize>::max(), '\n');
@@ -95,8 +1675,9 @@ public:
         }
 
         std::cout << "Enter price: ";
-        while (!(std::cin >> price) || price < 0) {
-            std::cout << "Invalid price. Please enter a non-negative number: ";
+        // Read as text and parse to exact cents; going through float would round
+        while (!(std::cin >> price_text) || !Money::parse(price_text, price)) {
+            std::cout << "Invalid price. Please enter a non-negative amount (e.g. 4.99): ";
             std::cin.clear();
             std::cin.ignore(std::numeric_limits<std::streamsize>::max(), '\n');
         }
@@ -106,21 +1687,15 @@ public:
         // std::cin.ignore(std::numeric_limits<std::streamsize>::max(), '\n');
 
 
-        // Check if item already exists to increment quantity instead of adding new
-        auto it = std::find_if(items.begin(), items.end(),
-                               [&name](const std::unique_ptr<Item>& item_ptr) {
-                                   return item_ptr->is_match(name);
-                               });
-
-        if (it != items.end()) {
-            // Item found, just update quantity
-            (*it)->set_quantity((*it)->get_quantity() + quantity);
+        // Existing items get their quantity incremented instead of a new entry
+        if (add(name, quantity, price).status == TransactionStatus::Merged) {
             std::cout << "\nItem '" << name << "' already exists. Quantity updated." << std::endl;
         } else {
-            // Item not found, add new
-            items.push_back(std::make_unique<Item>(name, quantity, price));
             std::cout << "\nNew item '" << name << "' added to inventory." << std::endl;
         }
+        if (!commit_log()) {
+            std::cout << "Warning: could not write the transaction log." << std::endl;
+        }
     }
 
 
@@ -135,25 +1710,19 @@ public:
         std::cout << "\nEnter item name to sell: ";
         std::getline(std::cin, item_to_check); // Use getline for names with spaces
 
-        // Find the item using an iterator
-        auto it = std::find_if(items.begin(), items.end(),
-                               [&item_to_check](const std::unique_ptr<Item>& item_ptr) {
-                                   return item_ptr->is_match(item_to_check);
-                               });
+        // Find the item's slot in the store
+        std::size_t slot = items.find(item_to_check);
 
-        if (it != items.end()) {
-            // Item found, pass the index or iterator to remove_item
-            // Passing iterator is more C++ idiomatic and potentially more efficient for vector::erase
-            remove_item(it);
+        if (slot != NameIndex::npos) {
+            remove_item(slot);
         } else {
             std::cout << "\nThis item is not in your Inventory." << std::endl;
         }
     }
 
-    // Modified remove_item to take an iterator
-    void remove_item(std::vector<std::unique_ptr<Item>>::iterator item_it) {
+    // Takes a store slot so the same code works for every storage backend
+    void remove_item(std::size_t slot) {
         int input_quantity;
-        Item *item = item_it->get(); // Get raw pointer from unique_ptr for convenience
 
         std::cout << "\nEnter number of items to sell: ";
         while (!(std::cin >> input_quantity) || input_quantity <= 0) {
@@ -162,50 +1731,746 @@ public:
             std::cin.ignore(std::numeric_limits<std::streamsize>::max(), '\n');
         }
 
-        int current_quantity = item->get_quantity();
-
-        if (input_quantity <= current_quantity) {
-            float price = item->get_price();
-            float money_earned = price * input_quantity;
+        std::string name = items.get_name(slot); // The slot is gone once the item sells out
+        TransactionResult result = sell(slot, input_quantity);
 
-            item->set_quantity(current_quantity - input_quantity);
-            std::cout << "\nItems sold.";
-            std::cout << "\nMoney received: " << money_earned;
-            total_money += money_earned;
+        if (result.status == TransactionStatus::InsufficientStock) {
+            std::cout << "\nCannot sell more items than you have (Current: " << result.quantity << ")." << std::endl;
+            return;
+        }
 
-            // Check if quantity reached zero after decrementing
-            if (item->get_quantity() == 0) {
-                std::cout << "\nItem '" << item->get_name() << "' quantity reached zero. Removing completely." << std::endl;
-                // No manual delete needed! unique_ptr handles it.
-                items.erase(item_it); // Remove the unique_ptr from the vector
-            }
+        std::cout << "\nItems sold.";
+        std::cout << "\nMoney received: " << result.money_earned;
 
-        } else { // input_quantity > current_quantity
-            std::cout << "\nCannot sell more items than you have (Current: " << current_quantity << ")." << std::endl;
+        if (result.status == TransactionStatus::SoldOut) {
+            std::cout << "\nItem '" << name << "' quantity reached zero. Removing completely." << std::endl;
+        }
+        if (!commit_log()) {
+            std::cout << "\nWarning: could not write the transaction log." << std::endl;
         }
     }
 
-    void list_items() {
+    // Formats the full listing into out (replacing its contents), so callers
+    // can send it anywhere with a single write
+    void write_listing(std::string &out) const {
+        out.clear();
         if (items.empty()) { // Use .empty() instead of checking item_count
-            std::cout << "\nInventory empty." << std::endl;
+            out += "\nInventory empty.\n";
             return;
         }
 
-        std::cout << "\n--- Current Inventory ---" << std::endl;
-        for (const auto& item_ptr : items) { // Use range-based for loop with const reference
-            display_data(*item_ptr); // Dereference unique_ptr to pass Item to display_data
-            std::cout << "\n";
+        out += "\n--- Current Inventory ---\n";
+        for (std::size_t slot = 0; slot < items.size(); ++slot) {
+            display_data(out, slot);
+            out += "\n";
+        }
+        out += "Total Money: ";
+        append_number(out, total_money);
+        out += "\n-------------------------\n";
+    }
+
+    // Builds the listing in one buffer and writes it with a single call
+    // instead of flushing std::cout after every line
+    void list_items() {
+        write_listing(listing_buffer);
+        std::cout.write(listing_buffer.data(), static_cast<std::streamsize>(listing_buffer.size()));
+        std::cout.flush();
+    }
+};
+
+// Default layout: one Item object per SKU
+using Inventory = BasicInventory<ItemStore>;
+// Cache-friendly parallel-array layout with the same interface
+using SoaInventory = BasicInventory<SoaItemStore>;
+// Linear-scan baseline, for benchmarks only
+using LinearInventory = BasicInventory<LinearItemStore>;
+
+// Inventory that many checkout threads can sell from at once. Items are split
+// into shards by name hash and each shard has its own lock, so sales of
+// different items rarely contend; the check-and-decrement of a sale happens
+// under the shard lock, so the stock can never go below zero. Revenue goes
+// into per-thread counters that are only summed when read.
+template <typename Store = SoaItemStore>
+class ConcurrentInventory {
+private:
+    struct alignas(64) Shard {
+        std::mutex lock;
+        Store items;
+    };
+
+    // Padded to a cache line so neighbouring threads don't false-share
+    struct alignas(64) RevenueCounter {
+        std::atomic<std::int64_t> cents{0};
+    };
+
+    std::size_t shard_mask;
+    std::unique_ptr<Shard[]> shards;
+    std::size_t counter_count;
+    std::unique_ptr<RevenueCounter[]> revenue;
+    TransactionLog *log = nullptr; // Not owned; null when not logging
+
+    static std::size_t round_up_to_power_of_two(std::size_t value) {
+        std::size_t result = 1;
+        while (result < value) {
+            result <<= 1;
+        }
+        return result;
+    }
+
+    // Uses the high bits of a mixed hash; the shard's own NameIndex probes with
+    // the low bits, so the two don't correlate
+    Shard &shard_for(std::string_view name) const {
+        std::uint64_t mixed = static_cast<std::uint64_t>(NameIndex::hash(name)) * 0x9E3779B97F4A7C15ull;
+        return shards[static_cast<std::size_t>(mixed >> 32) & shard_mask];
+    }
+
+    // Each thread gets a fixed counter for its lifetime
+    RevenueCounter &counter_for_this_thread() const {
+        static std::atomic<std::size_t> next_thread_id{0};
+        thread_local std::size_t thread_id = next_thread_id.fetch_add(1, std::memory_order_relaxed);
+        return revenue[thread_id % counter_count];
+    }
+
+public:
+    explicit ConcurrentInventory(
+        std::size_t shard_count = 64,
+        std::size_t thread_slots = std::thread::hardware_concurrency()
+    ) :
+        shard_mask{round_up_to_power_of_two(shard_count == 0 ? 1 : shard_count) - 1},
+        shards{std::make_unique<Shard[]>(shard_mask + 1)},
+        counter_count{thread_slots == 0 ? 1 : thread_slots},
+        revenue{std::make_unique<RevenueCounter[]>(counter_count)} {
+    }
+
+    // Records are appended under the shard lock, so the log has the same order
+    // per item as the store; the wait for durability happens after unlocking,
+    // which lets concurrent checkouts share one fsync.
+    void attach_log(TransactionLog *transaction_log) {
+        log = transaction_log;
+    }
+
+    // Spans include the wait for the shard lock and for durability
+    TransactionResult add(std::string_view name, int quantity, Money price) {
+        GAME_SPAN("ConcurrentInventory::add");
+        GAME_COUNT("inventory.add", 1);
+        TransactionResult result;
+        std::uint64_t sequence = 0;
+        {
+            Shard &shard = shard_for(name);
+            std::lock_guard<std::mutex> guard(shard.lock);
+            result = add_to_store(shard.items, name, quantity, price);
+            if (log != nullptr && (result.status == TransactionStatus::Added || result.status == TransactionStatus::Merged)) {
+                sequence = log->append(TransactionType::Add, name, quantity, price);
+            }
+        }
+        if (sequence != 0) {
+            log->wait_durable(sequence);
+        }
+        return result;
+    }
+
+    TransactionResult sell(std::string_view name, int quantity) {
+        GAME_SPAN("ConcurrentInventory::sell");
+        GAME_COUNT("inventory.sell", 1);
+        TransactionResult result;
+        std::uint64_t sequence = 0;
+        {
+            Shard &shard = shard_for(name);
+            std::lock_guard<std::mutex> guard(shard.lock);
+            std::size_t slot = shard.items.find(name);
+            if (slot == NameIndex::npos) {
+                return {TransactionStatus::NotFound, 0, Money{}};
+            }
+            result = sell_from_store(shard.items, slot, quantity);
+            if (log != nullptr && (result.status == TransactionStatus::Sold || result.status == TransactionStatus::SoldOut)) {
+                sequence = log->append(TransactionType::Sell, name, quantity, Money{});
+            }
+        }
+        if (result.money_earned != Money{}) {
+            counter_for_this_thread().cents.fetch_add(result.money_earned.get_cents(), std::memory_order_relaxed);
+        }
+        if (sequence != 0) {
+            log->wait_durable(sequence);
+        }
+        return result;
+    }
+
+    // Same contract as BasicInventory::apply; each transaction locks only its own shard
+    void apply(const Transaction *transactions, std::size_t count, TransactionResult *results) {
+        for (std::size_t i = 0; i < count; ++i) {
+            const Transaction &txn = transactions[i];
+            results[i] = txn.type == TransactionType::Add
+                             ? add(txn.name, txn.quantity, txn.price)
+                             : sell(txn.name, txn.quantity);
+        }
+    }
+
+    // Sum of all per-thread counters; exact once concurrent sales have finished
+    Money get_total_money() const {
+        Money total;
+        for (std::size_t i = 0; i < counter_count; ++i) {
+            total += Money::from_cents(revenue[i].cents.load(std::memory_order_relaxed));
+        }
+        return total;
+    }
+
+    std::size_t size() const {
+        std::size_t total = 0;
+        for (std::size_t i = 0; i <= shard_mask; ++i) {
+            std::lock_guard<std::mutex> guard(shards[i].lock);
+            total += shards[i].items.size();
+        }
+        return total;
+    }
+
+    Money total_value() const {
+        Money total;
+        for (std::size_t i = 0; i <= shard_mask; ++i) {
+            std::lock_guard<std::mutex> guard(shards[i].lock);
+            total += shards[i].items.total_value();
+        }
+        return total;
+    }
+};
+
+// --- Benchmark (--bench) ---
+
+// Zipf(exponent) ranks in [1, count] by rejection-inversion (Hormann and
+// Derflinger), so sampling needs no per-rank table even for 10M items
+class ZipfSampler {
+private:
+    double exponent;
+    double h_integral_x1;
+    double h_integral_n;
+    double s;
+
+    // log1p(x) / x and expm1(x) / x, accurate near zero
+    static double helper1(double x) {
+        return std::abs(x) > 1e-8 ? std::log1p(x) / x : 1.0 - x * (0.5 - x * (1.0 / 3.0 - 0.25 * x));
+    }
+
+    static double helper2(double x) {
+        return std::abs(x) > 1e-8 ? std::expm1(x) / x : 1.0 + x * 0.5 * (1.0 + x / 3.0 * (1.0 + 0.25 * x));
+    }
+
+    double h(double x) const {
+        return std::exp(-exponent * std::log(x));
+    }
+
+    double h_integral(double x) const {
+        double log_x = std::log(x);
+        return helper2((1.0 - exponent) * log_x) * log_x;
+    }
+
+    double h_integral_inverse(double x) const {
+        double t = std::max(-1.0, x * (1.0 - exponent));
+        return std::exp(helper1(t) * x);
+    }
+
+public:
+    ZipfSampler(std::uint64_t count, double exponent) :
+        exponent{exponent},
+        h_integral_x1{h_integral(1.5) - 1.0},
+        h_integral_n{h_integral(static_cast<double>(count) + 0.5)},
+        s{2.0 - h_integral_inverse(h_integral(2.5) - h(2.0))},
+        count{count} {
+    }
+
+    template <typename Random>
+    std::uint64_t operator()(Random &random) {
+        std::uniform_real_distribution<double> uniform(0.0, 1.0);
+        for (;;) {
+            double u = h_integral_n + uniform(random) * (h_integral_x1 - h_integral_n);
+            double x = h_integral_inverse(u);
+            std::uint64_t k = static_cast<std::uint64_t>(std::max(1.0, std::min(x + 0.5, static_cast<double>(count))));
+            if (static_cast<double>(k) - x <= s || u >= h_integral(static_cast<double>(k) + 0.5) - h(static_cast<double>(k))) {
+                return k;
+            }
+        }
+    }
+
+private:
+    std::uint64_t count;
+};
+
+// Synthetic SKU names "sku-<n>", written into a caller buffer so 10M-item
+// workloads don't hold 10M strings
+inline std::string_view bench_name(char (&buffer)[24], std::uint64_t item) {
+    std::memcpy(buffer, "sku-", 4);
+    auto result = std::to_chars(buffer + 4, buffer + sizeof(buffer), item);
+    return std::string_view(buffer, static_cast<std::size_t>(result.ptr - buffer));
+}
+
+// Bytes currently allocated from malloc, heap plus large mmapped blocks
+inline std::size_t bench_heap_in_use() {
+    struct mallinfo2 info = mallinfo2();
+    return info.uordblks + info.hblkhd;
+}
+
+// One operation of the stream: rank 1 is the hottest SKU. Ranks are spread
+// over the catalogue by a multiplicative permutation, so hot SKUs are not
+// also the first ones inserted.
+struct BenchOperation {
+    bool is_add;
+    std::uint64_t item;
+    int quantity;
+};
+
+inline std::vector<BenchOperation> make_bench_stream(std::uint64_t item_count, std::size_t op_count,
+                                                     double exponent, std::uint64_t seed) {
+    std::mt19937_64 random{seed};
+    ZipfSampler zipf{item_count, exponent};
+    std::vector<BenchOperation> stream(op_count);
+    for (BenchOperation &op : stream) {
+        std::uint64_t rank = zipf(random) - 1;
+        op.is_add = (random() & 1) != 0;
+        op.item = (rank * 2654435761ull) % item_count;
+        op.quantity = 1 + static_cast<int>(random() % 10);
+    }
+    return stream;
+}
+
+struct BenchResult {
+    double ops_per_second;
+    double bytes_per_item;
+    double p50_ns;
+    double p99_ns;
+    double p999_ns;
+};
+
+inline double bench_percentile(std::vector<std::uint32_t> &latencies, double fraction) {
+    if (latencies.empty()) {
+        return 0.0;
+    }
+    std::size_t rank = static_cast<std::size_t>(fraction * static_cast<double>(latencies.size() - 1));
+    std::nth_element(latencies.begin(), latencies.begin() + rank, latencies.end());
+    return latencies[rank];
+}
+
+// Replays stream against inventory on thread_count threads, thread t taking
+// every thread_count-th operation, and times every operation
+template <typename InventoryType>
+void bench_replay(InventoryType &inventory, const std::vector<BenchOperation> &stream, unsigned thread_count,
+                  double &seconds, std::vector<std::uint32_t> &latencies) {
+    std::vector<std::vector<std::uint32_t>> per_thread(thread_count);
+    auto run = [&](unsigned thread) {
+        std::vector<std::uint32_t> &samples = per_thread[thread];
+        samples.reserve(stream.size() / thread_count + 1);
+        char buffer[24];
+        for (std::size_t i = thread; i < stream.size(); i += thread_count) {
+            const BenchOperation &op = stream[i];
+            std::string_view name = bench_name(buffer, op.item);
+            auto start = std::chrono::steady_clock::now();
+            if (op.is_add) {
+                inventory.add(name, op.quantity, Money::from_cents(199));
+            } else {
+                inventory.sell(name, op.quantity);
+            }
+            auto elapsed = std::chrono::steady_clock::now() - start;
+            samples.push_back(static_cast<std::uint32_t>(
+                std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count()));
+        }
+    };
+
+    auto start = std::chrono::steady_clock::now();
+    if (thread_count == 1) {
+        run(0);
+    } else {
+        std::vector<std::thread> threads;
+        for (unsigned t = 0; t < thread_count; ++t) {
+            threads.emplace_back(run, t);
+        }
+        for (std::thread &thread : threads) {
+            thread.join();
+        }
+    }
+    seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    for (const auto &samples : per_thread) {
+        latencies.insert(latencies.end(), samples.begin(), samples.end());
+    }
+}
+
+// Builds an inventory of item_count SKUs (1000 units each), then replays the
+// stream. Memory per item is the heap growth of the build; names are interned
+// before the build, since every inventory shares them.
+template <typename InventoryType, typename... Args>
+BenchResult run_bench(std::uint64_t item_count, const std::vector<BenchOperation> &stream, unsigned thread_count,
+                      Args &&...args) {
+    std::size_t heap_before = bench_heap_in_use();
+    auto inventory = std::make_unique<InventoryType>(std::forward<Args>(args)...);
+    char buffer[24];
+    for (std::uint64_t item = 0; item < item_count; ++item) {
+        inventory->add(bench_name(buffer, item), 1000, Money::from_cents(199));
+    }
+    std::size_t heap_after = bench_heap_in_use();
+
+    double seconds = 0.0;
+    std::vector<std::uint32_t> latencies;
+    latencies.reserve(stream.size());
+    bench_replay(*inventory, stream, thread_count, seconds, latencies);
+
+    BenchResult result;
+    result.ops_per_second = seconds > 0.0 ? static_cast<double>(stream.size()) / seconds : 0.0;
+    result.bytes_per_item = heap_after > heap_before
+                                ? static_cast<double>(heap_after - heap_before) / static_cast<double>(item_count)
+                                : 0.0;
+    result.p50_ns = bench_percentile(latencies, 0.50);
+    result.p99_ns = bench_percentile(latencies, 0.99);
+    result.p999_ns = bench_percentile(latencies, 0.999);
+    return result;
+}
+
+inline void print_bench_row(const char *variant, std::uint64_t item_count, const BenchResult &result) {
+    std::printf("%-11s %10llu %14.0f %12.1f %10.0f %10.0f %10.0f\n", variant,
+                static_cast<unsigned long long>(item_count), result.ops_per_second, result.bytes_per_item,
+                result.p50_ns, result.p99_ns, result.p999_ns);
+}
+
+struct BenchOptions {
+    std::vector<std::uint64_t> sizes{1000, 100000, 1000000};
+    std::size_t op_count = 1000000;
+    double exponent = 1.0;
+    std::uint64_t seed = 1;
+    unsigned threads = std::max(1u, std::thread::hardware_concurrency());
+    std::uint64_t linear_limit = 10000; // The linear scan is skipped above this many items
+};
+
+// Same seeded stream for every variant at a given size
+inline int run_benchmarks(const BenchOptions &options) {
+    std::printf("%-11s %10s %14s %12s %10s %10s %10s\n", "variant", "items", "ops/s", "bytes/item",
+                "p50(ns)", "p99(ns)", "p99.9(ns)");
+    for (std::uint64_t item_count : options.sizes) {
+        if (item_count == 0) {
+            continue;
+        }
+        char buffer[24];
+        for (std::uint64_t item = 0; item < item_count; ++item) {
+            NameTable::shared().intern(bench_name(buffer, item));
+        }
+        std::vector<BenchOperation> stream = make_bench_stream(item_count, options.op_count, options.exponent,
+                                                               options.seed);
+        if (item_count <= options.linear_limit) {
+            print_bench_row("linear", item_count, run_bench<LinearInventory>(item_count, stream, 1));
+        } else {
+            std::printf("%-11s %10llu %14s\n", "linear", static_cast<unsigned long long>(item_count), "skipped");
+        }
+        print_bench_row("indexed", item_count, run_bench<Inventory>(item_count, stream, 1));
+        print_bench_row("soa", item_count, run_bench<SoaInventory>(item_count, stream, 1));
+        print_bench_row("concurrent", item_count,
+                        run_bench<ConcurrentInventory<>>(item_count, stream, options.threads));
+    }
+    return 0;
+}
+
+// --- Self-test (--self-test) ---
+
+// Checks the recovery paths that are hard to reach from the menu, in a
+// scratch directory. Each check prints one line; returns 1 if any failed.
+class SelfTest {
+private:
+    std::string directory;
+    std::vector<std::string> files; // Removed with the directory at the end
+    int failures = 0;
+
+    std::string scratch_file(const char *name) {
+        files.push_back(directory + "/" + name);
+        return files.back();
+    }
+
+    static bool read_file(const std::string &path, std::string &contents) {
+        std::FILE *file = std::fopen(path.c_str(), "rb");
+        if (file == nullptr) {
+            return false;
+        }
+        contents.clear();
+        char chunk[4096];
+        std::size_t got;
+        while ((got = std::fread(chunk, 1, sizeof(chunk), file)) > 0) {
+            contents.append(chunk, got);
+        }
+        std::fclose(file);
+        return true;
+    }
+
+    static bool write_file(const std::string &path, const std::string &contents) {
+        std::FILE *file = std::fopen(path.c_str(), "wb");
+        if (file == nullptr) {
+            return false;
+        }
+        bool written = std::fwrite(contents.data(), 1, contents.size(), file) == contents.size();
+        return std::fclose(file) == 0 && written;
+    }
+
+    // In stock, or 0 when the item is missing
+    template <typename InventoryType>
+    static int stock_of(InventoryType &inventory, std::string_view name) {
+        return inventory.sell(name, std::numeric_limits<int>::max()).quantity;
+    }
+
+    void check(bool passed, const char *what) {
+        std::printf("%-6s %s\n", passed ? "ok" : "FAILED", what);
+        failures += passed ? 0 : 1;
+    }
+
+    static bool parses_to(std::string_view text, std::int64_t cents) {
+        Money amount;
+        return Money::parse(text, amount) && amount == Money::from_cents(cents);
+    }
+
+    static bool rejects(std::string_view text) {
+        Money amount;
+        return !Money::parse(text, amount);
+    }
+
+    // Amounts are exact cents: no float rounding, at most two decimals, never
+    // negative, and nothing that would overflow
+    void money_parsing() {
+        check(parses_to("12", 1200) && parses_to("12.5", 1250) && parses_to("12.34", 1234) && parses_to(".05", 5)
+                  && parses_to("0.1", 10) && parses_to("19.99", 1999) && parses_to("12.", 1200),
+              "money parses to exact cents");
+        check(rejects("12.345") && rejects("0.999") && rejects("") && rejects(".") && rejects("1.x") && rejects("1e3"),
+              "money with more than two decimals or stray characters is rejected");
+        check(rejects("-1") && rejects("-0.50") && rejects("1.-5"), "negative money is rejected");
+        const std::int64_t max_cents = std::numeric_limits<std::int64_t>::max();
+        check(parses_to("92233720368547757.99", (max_cents - 99) / 100 * 100 + 99) && rejects("92233720368547758")
+                  && rejects("99999999999999999") && rejects("99999999999999999999"),
+              "money too large for int64 cents is rejected");
+        Money huge = Money::from_cents(max_cents / 2 + 1);
+        Money total = huge * 2;
+        total += huge;
+        check(total == Money::from_cents(max_cents) && huge * std::numeric_limits<int>::max() == Money::from_cents(max_cents)
+                  && Money::from_cents(-max_cents) * 2 == Money::from_cents(std::numeric_limits<std::int64_t>::min()),
+              "money arithmetic saturates instead of overflowing");
+    }
+
+    // A crash after the snapshot is written but before the log moves to the
+    // next generation leaves a log the snapshot already contains. Sales made
+    // after restarting on it must survive the restart after that.
+    void crash_between_snapshot_and_log() {
+        std::string snapshot_path = scratch_file("crash.snapshot");
+        std::string log_path = scratch_file("crash.log");
+        std::string stale_log;
+        {
+            Inventory inventory;
+            TransactionLog log;
+            std::size_t replayed = 0;
+            inventory.open_log(log, log_path, replayed);
+            inventory.add("Sword", 5, Money::from_cents(1500));
+            inventory.commit_log();
+            read_file(log_path, stale_log);
+            inventory.save_snapshot(snapshot_path);
+        }
+        write_file(log_path, stale_log); // As if begin_next_generation never ran
+        {
+            Inventory inventory;
+            TransactionLog log;
+            std::size_t replayed = 0;
+            inventory.load_snapshot(snapshot_path);
+            check(inventory.open_log(log, log_path, replayed) && replayed == 0,
+                  "restart skips the log the snapshot absorbed");
+            inventory.sell("Sword", 2);
+            check(inventory.commit_log(), "sale after the restart is durable");
+        }
+        Inventory inventory;
+        TransactionLog log;
+        std::size_t replayed = 0;
+        inventory.load_snapshot(snapshot_path);
+        inventory.open_log(log, log_path, replayed);
+        check(replayed == 1 && stock_of(inventory, "Sword") == 3, "sale survives the next restart");
+    }
+
+    // A batch reports each transaction's result and whether the log made it durable
+    void batch_results() {
+        std::string log_path = scratch_file("batch.log");
+        Inventory inventory;
+        TransactionLog log;
+        std::size_t replayed = 0;
+        inventory.open_log(log, log_path, replayed);
+        std::vector<Transaction> batch = {{TransactionType::Add, "Arrow", 20, Money::from_cents(10)},
+                                          {TransactionType::Sell, "Arrow", 5, Money{}},
+                                          {TransactionType::Sell, "Quiver", 1, Money{}}};
+        std::vector<TransactionResult> results;
+        check(inventory.apply(batch, results) && results.size() == 3 && results[1].quantity == 15
+                  && results[2].status == TransactionStatus::NotFound,
+              "batch is durable with one result per transaction");
+    }
+
+    // Drops as LootPipeline::distribute hands them over: repeats of one entry
+    // merge into one stack at the table's price
+    void loot_delivery() {
+        const LootTable table{{{"Gold Coin", 1000, 1, 5, 1}, {"Health Potion", 250, 1, 1, 50}}};
+        const LootDrop drops[] = {{&table.entries[0], 3}, {&table.entries[1], 1}, {&table.entries[0], 2}};
+        Inventory inventory;
+        TransactionResult results[3];
+        inventory.add_loot(drops, 3, results);
+        check(inventory.size() == 2 && results[2].status == TransactionStatus::Merged && results[2].quantity == 5
+                  && inventory.total_value() == Money::from_cents(55) && stock_of(inventory, "Gold Coin") == 5,
+              "loot drops are added in one batch");
+    }
+
+    // A record whose checksum matches but whose type is neither Add nor Sell
+    // ends replay instead of being taken for a sale
+    void unknown_log_record_type() {
+        std::string log_path = scratch_file("type.log");
+        {
+            Inventory inventory;
+            TransactionLog log;
+            std::size_t replayed = 0;
+            inventory.open_log(log, log_path, replayed);
+            inventory.add("Sword", 5, Money::from_cents(1500));
+            inventory.sell("Sword", 2);
+            inventory.commit_log();
         }
-        std::cout << "Total Money: " << total_money << std::endl;
-        std::cout << "-------------------------" << std::endl;
+        std::string contents;
+        read_file(log_path, contents);
+        std::size_t sell_record = log_header_size + log_record_head_size + std::string_view("Sword").size();
+        bool laid_out = contents.size() == sell_record + log_record_head_size + 5;
+        if (laid_out) {
+            contents[sell_record + 4] = 7;
+            std::uint32_t checksum = log_checksum(&contents[sell_record + 4], contents.size() - sell_record - 4);
+            std::memcpy(&contents[sell_record], &checksum, sizeof(checksum));
+            write_file(log_path, contents);
+        }
+        Inventory inventory;
+        TransactionLog log;
+        std::size_t replayed = 0;
+        inventory.open_log(log, log_path, replayed);
+        check(laid_out && replayed == 1 && stock_of(inventory, "Sword") == 5, "log record of an unknown type ends replay");
+    }
+
+    // Threads adding to and selling from the same few items, on fewer shards
+    // and revenue counters than threads, must end with exactly the stock and
+    // revenue their results add up to
+    void concurrent_totals() {
+        constexpr int thread_count = 4;
+        constexpr int rounds = 20000;
+        const std::string_view names[] = {"Arrow", "Bolt", "Dart", "Stone", "Spear", "Javelin"};
+        constexpr std::size_t name_count = sizeof(names) / sizeof(names[0]);
+        ConcurrentInventory<> inventory(2, 2);
+        for (std::string_view name : names) {
+            inventory.add(name, 100, Money::from_cents(25));
+        }
+        std::int64_t sold[thread_count][name_count] = {};
+        std::int64_t earned[thread_count] = {};
+        std::vector<std::thread> threads;
+        for (int t = 0; t < thread_count; ++t) {
+            threads.emplace_back([&, t] {
+                for (int i = 0; i < rounds; ++i) {
+                    std::size_t item = static_cast<std::size_t>(i + t) % name_count;
+                    inventory.add(names[item], 2, Money::from_cents(25));
+                    TransactionResult result = inventory.sell(names[(item + 1) % name_count], 3);
+                    if (result.status == TransactionStatus::Sold || result.status == TransactionStatus::SoldOut) {
+                        sold[t][(item + 1) % name_count] += 3;
+                        earned[t] += result.money_earned.get_cents();
+                    }
+                }
+            });
+        }
+        for (std::thread &thread : threads) {
+            thread.join();
+        }
+        std::int64_t revenue = 0;
+        std::int64_t units_sold = 0;
+        for (int t = 0; t < thread_count; ++t) {
+            revenue += earned[t];
+            for (std::size_t item = 0; item < name_count; ++item) {
+                units_sold += sold[t][item];
+            }
+        }
+        bool revenue_matches = units_sold > 0 && revenue == units_sold * 25
+                               && inventory.get_total_money() == Money::from_cents(revenue);
+        bool stock_matches = true;
+        for (std::size_t item = 0; item < name_count; ++item) {
+            std::int64_t stock = 100;
+            for (int t = 0; t < thread_count; ++t) {
+                for (int i = 0; i < rounds; ++i) {
+                    stock += static_cast<std::size_t>(i + t) % name_count == item ? 2 : 0;
+                }
+                stock -= sold[t][item];
+            }
+            stock_matches = stock_matches && stock_of(inventory, names[item]) == stock;
+        }
+        check(revenue_matches && stock_matches,
+              "concurrent adds and sales add up to their results");
+    }
+
+    // Every offset in the header must match the layout its counts imply;
+    // otherwise loading would read outside the mapping
+    void corrupt_snapshot_offsets() {
+        std::string path = scratch_file("corrupt.snapshot");
+        SoaInventory saved;
+        saved.add("Shield", 2, Money::from_cents(900));
+        saved.add("Bow", 1, Money::from_cents(4000));
+        saved.save_snapshot(path);
+        std::string image;
+        read_file(path, image);
+        SoaInventory loaded;
+        check(loaded.load_snapshot(path) && loaded.size() == 2 && stock_of(loaded, "Bow") == 1,
+              "snapshot loads from the mapped arrays");
+
+        const std::size_t offset_fields[] = {offsetof(SnapshotHeader, prices_offset),
+                                             offsetof(SnapshotHeader, name_offsets_offset),
+                                             offsetof(SnapshotHeader, quantities_offset)};
+        bool all_rejected = true;
+        for (std::size_t field : offset_fields) {
+            std::string corrupt = image;
+            std::uint64_t offset = std::uint64_t{1} << 40;
+            std::memcpy(&corrupt[field], &offset, sizeof(offset));
+            write_file(path, corrupt);
+            all_rejected = all_rejected && !loaded.load_snapshot(path);
+        }
+        check(all_rejected, "snapshot with an out-of-range array offset is rejected");
+        write_file(path, image.substr(0, image.size() - 1));
+        std::size_t before = loaded.size();
+        check(!loaded.load_snapshot(path) && loaded.size() == before, "truncated snapshot is rejected");
+    }
+
+public:
+    int run() {
+        char scratch[] = "/tmp/inventory-self-test-XXXXXX";
+        if (mkdtemp(scratch) == nullptr) {
+            std::printf("could not create a scratch directory\n");
+            return 1;
+        }
+        directory = scratch;
+        money_parsing();
+        crash_between_snapshot_and_log();
+        unknown_log_record_type();
+        corrupt_snapshot_offsets();
+        batch_results();
+        loot_delivery();
+        concurrent_totals();
+        for (const std::string &file : files) {
+            ::unlink(file.c_str());
+        }
+        ::rmdir(scratch);
+        std::printf("%d failed\n", failures);
+        return failures == 0 ? 0 : 1;
     }
 };
 
-int main() {
+template <typename InventoryType>
+int run_menu(const std::string &snapshot_path, const std::string &log_path) {
     int choice;
-    Inventory inventory_system;
+    InventoryType inventory_system;
+    TransactionLog log;
     std::cout << "Welcome to the inventory!";
 
+    if (!snapshot_path.empty() && inventory_system.load_snapshot(snapshot_path)) {
+        std::cout << "\nLoaded " << inventory_system.size() << " items from " << snapshot_path << ".";
+    }
+    if (!log_path.empty()) {
+        std::size_t replayed = 0;
+        bool opened = inventory_system.open_log(log, log_path, replayed);
+        if (replayed > 0) {
+            std::cout << "\nReplayed " << replayed << " transactions from " << log_path << ".";
+        }
+        if (!opened) {
+            std::cout << "\nCould not open transaction log " << log_path << "." << std::endl;
+            return 1;
+        }
+    }
+
     while (true) { // Use 'true' for infinite loop, clearer than '1'
         std::cout << "\n\nMENU\n"
                   << "1. Add new item\n"
@@ -229,6 +2494,10 @@ int main() {
                 break;
 
             case 4:
+                if (!snapshot_path.empty() && !inventory_system.save_snapshot(snapshot_path)) {
+                    std::cout << "\nCould not save snapshot to " << snapshot_path << "." << std::endl;
+                    return 1;
+                }
                 return 0; // Use return 0 instead of exit(0) for clean exit
 
             default:
@@ -239,4 +2508,75 @@ int main() {
                 break;
         }
     }
-}
\ No newline at end of file
+}
+
+int main(int argc, char *argv[]) {
+    bool use_soa = false;
+    bool bench = false;
+    bool self_test = false;
+    BenchOptions bench_options;
+    std::string snapshot_path;
+    std::string log_path;
+    std::string trace_path;
+    for (int i = 1; i < argc; ++i) {
+        std::string_view arg = argv[i];
+        if (arg == "--bench") {
+            // Run the microbenchmarks instead of the menu
+            bench = true;
+        } else if (arg == "--self-test") {
+            // Check crash recovery in a scratch directory instead of running the menu
+            self_test = true;
+        } else if (arg == "--bench-sizes" && i + 1 < argc) {
+            // Comma-separated item counts, e.g. 1000,10000000
+            bench_options.sizes.clear();
+            for (const char *cursor = argv[++i]; *cursor != '\0';) {
+                char *end = nullptr;
+                bench_options.sizes.push_back(std::strtoull(cursor, &end, 10));
+                cursor = *end == ',' ? end + 1 : end;
+                if (end == cursor && *cursor != '\0') {
+                    break; // Not a number
+                }
+            }
+        } else if (arg == "--bench-ops" && i + 1 < argc) {
+            bench_options.op_count = std::strtoull(argv[++i], nullptr, 10);
+        } else if (arg == "--bench-zipf" && i + 1 < argc) {
+            bench_options.exponent = std::strtod(argv[++i], nullptr);
+        } else if (arg == "--bench-linear-limit" && i + 1 < argc) {
+            bench_options.linear_limit = std::strtoull(argv[++i], nullptr, 10);
+        } else if (arg == "--bench-threads" && i + 1 < argc) {
+            bench_options.threads = std::max(1u, static_cast<unsigned>(std::strtoull(argv[++i], nullptr, 10)));
+        } else if (arg == "--soa") {
+            // Run the menu over the structure-of-arrays storage
+            use_soa = true;
+        } else if (arg == "--snapshot" && i + 1 < argc) {
+            // Load the inventory from this file at startup and save it on exit
+            snapshot_path = argv[++i];
+        } else if (arg == "--log" && i + 1 < argc) {
+            // Record every transaction in this log and replay it at startup
+            log_path = argv[++i];
+        } else if (arg == "--trace" && i + 1 < argc) {
+            // Write recorded spans and counters here as a Chrome trace on exit
+            trace_path = argv[++i];
+        }
+    }
+    int status;
+    if (self_test) {
+        status = SelfTest().run();
+    } else if (bench) {
+        status = run_benchmarks(bench_options);
+    } else if (use_soa) {
+        status = run_menu<SoaInventory>(snapshot_path, log_path);
+    } else {
+        status = run_menu<Inventory>(snapshot_path, log_path);
+    }
+    if (!trace_path.empty()) {
+        if (!instrumentation::enabled) {
+            std::cout << "Built without GAME_INSTRUMENTATION; the trace will be empty." << std::endl;
+        }
+        if (!instrumentation::Registry::instance().writeChromeTrace(trace_path)) {
+            std::cout << "Could not write trace to " << trace_path << "." << std::endl;
+            return 1;
+        }
+    }
+    return status;
+}